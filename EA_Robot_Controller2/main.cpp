@@ -13,15 +13,38 @@
 #include <numeric>
 #include <list>
 #include <algorithm>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <cstdint>
+#include <climits>
+#include <memory>
+#include <cstring>
+#include <array>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//the batched and single-robot kernels only round alike if no a*b+c is fused into one FMA, which -mfma or -march=native would otherwise allow
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
 
 using namespace std;
 
 struct PointMass{
     double mass;
-    vector<float> position; // {x, y, z}
-    vector<float> velocity; // {v_x, v_y, v_z}
-    vector<float> acceleration; // {a_x, a_y, a_z}
-    vector<float> forces; // {f_x, f_y, f_z}
+    array<float, 3> position; // {x, y, z}
+    array<float, 3> velocity; // {v_x, v_y, v_z}
+    array<float, 3> acceleration; // {a_x, a_y, a_z}
+    array<float, 3> forces; // {f_x, f_y, f_z}
     int ID; //index of where a particular mass lies in the robot.masses vector https://forms.gle/bKtGGQKmbtsS6kSV7
     
 };
@@ -44,10 +67,36 @@ struct Cube{
     vector<int> joinedFaces; //faces of the cube that are joined to other cubes
     vector<int> massIDs; //where the verteces of the cube correspond to the Robot.masses vector
     vector<int> springIDs; //where the springs of the cube correspond to the Robot.springs vector
-    vector<int> free_faces;
+    uint8_t free_faces = 0; //bit f set while face f is open
     vector<float> center;
 };
 
+struct CubeGrid{
+    //integer voxel coordinates of the cubes placed so far, measured in cube widths from cube 0, so finding a cube's neighbours is six lookups instead of a scan over all_cubes
+    vector<pair<int64_t, int>> cells; //(packed voxel, cube there), sorted; a voxel has more than one cube only where a crossover overlaps two
+};
+
+struct CubePool{
+    //cubes that still have a free face; unordered, a removal moves the last entry into the hole
+    vector<int> cubes;
+    vector<int> slot; //where each cube sits in cubes, -1 when it is not there
+};
+
+struct CubeAssembly{
+    //bookkeeping for the cube being placed, as bitmasks over its own vertices and springs
+    uint32_t masses_left = 0; //bit v set while vertex v is not shared with a cube already placed
+    uint32_t springs_left = 0; //same for the 28 springs
+    vector<int> mass_cube; //robot mass -> last cube it was listed in massIDs for, so a membership test is one compare
+    vector<int> spring_cube; //robot spring -> last cube it was listed in springIDs for
+};
+
+struct BuildScratch{
+    //the decoder's working state; each thread keeps one and clears it per decode, so decoding reuses its capacity instead of allocating
+    CubeGrid grid;
+    CubeAssembly assembly;
+    vector<pair<int, int>> neighbors; //(cube, direction), see fuse_neighbors
+};
+
 struct Equation{
     float k;
     float a;
@@ -62,42 +111,274 @@ struct Controller{
     float fitness = 0;
 };
 
+struct Placement{
+    int parent; //cube the new cube is fused to
+    int face; //face of the new cube that touches the parent
+};
+
+struct RobotBody;
+
 struct Robot{
-    vector<PointMass> masses; //vector of masses that make up the robot
-    vector<Spring> springs; //vector of springs that make up the robot
-    vector<int> cubes;
-    vector<Cube> all_cubes;
-    vector<int> available_cubes;
+    vector<Placement> genome; //how every cube after the first was placed, in build order
+    shared_ptr<const RobotBody> body; //built from genome on first use, see robot_body
     float fitness = 0;
     Controller best_controller;
     vector<float> center;
 };
 
-const double g = -9.81; //acceleration due to gravity
-const double b = 1; //damping (optional) Note: no damping means your cube will bounce forever
+struct SimTopology{
+    //the packed values no simulation changes, shared by every run of a robot
+    vector<double> mass;
+    vector<float> mass_single; //mass rounded to float, for the single precision kernels
+    vector<int> m0; //spring endpoints (indices into the mass arrays)
+    vector<int> m1;
+    vector<int> body_spring; //simulated spring -> first of the robot's springs on that edge
+    vector<int> merged_first; //simulated spring i -> the other robot springs on its edge, merged_springs[merged_first[i]] up to merged_first[i+1]
+    vector<int> merged_springs;
+    float stiffest = 0; //largest sum over one mass of 2k/m at the stiffest k its springs can be given, which bounds the squared natural frequency
+    float lightest = 0; //smallest mass, which the ground penalty shakes fastest
+};
+
+struct PhaseTable{
+    //the distinct (w, c) pairs the motors of a run use; each step takes one sine per pair and every motor and lane reads its own
+    vector<float> w, c;
+    vector<float> value; //sin(w*T+c) of every pair for the current step
+    vector<int> motor_phase; //[motor][lane] -> pair
+};
+
+struct SimState{
+    //packed structure-of-arrays copy of a Robot's masses and springs; this is all the inner step loop touches
+    int n_masses = 0;
+    int n_springs = 0;
+    const double *mass = nullptr; //into the robot's SimTopology
+    const float *mass_single = nullptr;
+    const int *m0 = nullptr;
+    const int *m1 = nullptr;
+    vector<float> px, py, pz; //positions
+    vector<float> vx, vy, vz; //velocities
+    vector<float> fx, fy, fz; //forces
+    vector<float> L0; //resting lengths
+    vector<float> L; //current lengths
+    vector<float> k; //spring constants
+    vector<float> sfx, sfy, sfz; //force each spring applies to its m0 mass (m1 gets the negative)
+    vector<float> motor_wave; //a*sin(w*T+c) of every cube for the current step, plus a trailing 0 for the idle motor
+    vector<float> motor_k; //k of every cube for the current step, plus spring_constant for the idle motor
+    PhaseTable phases;
+    vector<int> contacts; //masses touching the ground this step, see update_forces
+    vector<float> ax, ay, az; //last step's accelerations, for velocity Verlet
+    float last_dt = 0; //dt of the step that took the masses to where ax, ay, az were taken; 0 until there is one
+};
+
+struct BatchState;
+struct ActuationPlan;
+struct SimContext;
+typedef void (*BatchStep)(BatchState &batch, const ActuationPlan &plan, vector<const Controller*> &controls, const SimContext &ctx);
+
+struct BatchState{
+    //lanes copies of one robot stepped in lockstep; per-mass and per-spring values are laid out [index][lane] so each mass or spring is processed across the whole batch at once
+    int lanes = 0;
+    int n_masses = 0;
+    int n_springs = 0;
+    int n_motors = 0;
+    const double *mass = nullptr; //shared by every lane, into the robot's SimTopology
+    const float *mass_single = nullptr;
+    const int *m0 = nullptr;
+    const int *m1 = nullptr;
+    vector<float> px, py, pz; //[mass][lane]
+    vector<float> vx, vy, vz;
+    vector<float> fx, fy, fz;
+    vector<float> L0; //[spring][lane]
+    vector<float> k;
+    vector<float> motor_wave; //[motor][lane], plus a trailing idle motor that stays 0
+    vector<float> motor_k;
+    PhaseTable phases; //pairs of every lane's controller
+    vector<int> contacts; //masses touching the ground in at least one lane this step
+    vector<float> ax, ay, az; //[mass][lane], last step's accelerations for velocity Verlet
+    float last_dt = 0;
+    BatchStep step = nullptr; //kernels compiled for this many lanes, see batch_step
+};
+
+struct SimContext{
+    //clock and physics constants of one simulation; every evaluation owns its own, so simulations never share mutable state
+    float T = 0.0; //time that has passed
+    float dt = 0.0001;
+    double g = -9.81; //acceleration due to gravity
+    double b = 1; //damping (optional) Note: no damping means your cube will bounce forever
+    float mu_s = 0.74; //coefficient of static friction
+    float mu_k = 0.57; //coefficient of kinetic friction
+    float contact_margin = INFINITY; //height under which a mass gets the ground penalty and friction pass; infinite, as originally, unless --contact-friction, see update_forces
+    int steps_per_run = 50; //steps between checkpoints; steps_per_run*dt is always checkpoint_time, see choose_timestep
+};
+
+struct Rng{
+    //xoshiro256** state; every random decision draws from one of these, so a run is fixed by its seed
+    uint64_t s[4];
+};
+
+struct FitnessJob{
+    const Controller *control; //controller to test
+    const Robot *robot; //robot to test it on
+    float fitness = 0;
+    float incumbent = -1; //with racing on, the run may stop once it cannot beat this; negative means the exact fitness is needed
+    int steps_skipped = 0; //steps racing did not simulate; nonzero means fitness is only the displacement when the run stopped
+};
+
+struct EvaluationPool{
+    //worker threads that run determine_fitness for batches of FitnessJobs; the submitting thread works on the batch too
+    vector<thread> workers;
+    mutex lock;
+    condition_variable wake; //a batch was submitted or the pool is stopping
+    condition_variable finished; //the last job of the batch is done
+    vector<FitnessJob> *jobs = nullptr;
+    vector<int> task_first; //jobs are run in tasks of consecutive jobs; task t is jobs task_first[t] up to task_first[t+1]
+    int next_task = 0;
+    int jobs_done = 0;
+    bool stopping = false;
+};
+
+struct FitnessKey{
+    //identifies one simulation: two independent hashes of the robot's shape, plus the controller's equations
+    uint64_t robot_hash = 0;
+    uint64_t robot_check = 0;
+    vector<Equation> motor;
+};
+
+struct FitnessCache{
+    //least recently used cache of finished simulations; the simulation is deterministic, so a hit is the fitness it would have computed, up to rounding for a differently built copy of a shape
+    size_t capacity = 20000;
+    list<pair<FitnessKey, float>> entries; //most recently used first
+    unordered_map<uint64_t, list<pair<FitnessKey, float>>::iterator> index;
+    long hits = 0;
+    long misses = 0;
+};
+
+struct ActuatorEntry{
+    int spring; //index into the robot's springs
+    float original_L0;
+    int length_motor; //cube whose equation breathes this spring's resting length
+    int stiffness_motor; //cube whose equation sets this spring's k; differs from length_motor only for some springs shared by several cubes
+};
+
+struct MergedActuator{
+    //a simulated spring standing in for coincident robot springs: k is their sum and L0 their k-weighted mean, which gives the same force
+    int spring;
+    int first, count; //its robot springs' entries in ActuationPlan::merged_parts
+};
+
+struct ActuationPlan{
+    //compiled once per robot so each step is one pass over the actuated springs instead of a search through every cube's springs
+    int n_motors = 0;
+    vector<ActuatorEntry> entries;
+    vector<MergedActuator> merged;
+    vector<ActuatorEntry> merged_parts; //stiffness_motor is the idle motor n_motors, holding spring_constant, for a part no cube stiffens
+};
+
+struct RobotBody{
+    //simulation topology decoded from a genome; never changed once built, so every copy of a robot shares one
+    vector<PointMass> masses; //vector of masses that make up the robot
+    vector<Spring> springs; //vector of springs that make up the robot
+    vector<Cube> all_cubes;
+    CubePool available_cubes;
+    SimTopology topology;
+    SimState initial; //starting state of every run, copied into a worker's own buffer; points into topology, so a body is never copied
+    ActuationPlan plan;
+    uint64_t shape_hash = 0; //two independent hashes of the canonical shape, see hash_shape
+    uint64_t shape_check = 0;
+    
+    RobotBody() = default;
+    RobotBody(const RobotBody &) = delete;
+    RobotBody &operator=(const RobotBody &) = delete;
+};
+
 const float spring_constant = 5000.0f; //this worked best for me given my dt and mass of each PointMass
-const float mu_s = 0.74; //coefficient of static friction
-const float mu_k = 0.57; //coefficient of kinetic friction
-float T = 0.0;
-float dt = 0.0001;
 bool breathing = true;
+bool batching = true; //simulate jobs that share a robot together in lockstep batches
+
+enum Integrator{
+    SEMI_IMPLICIT_EULER, //the original: the new velocity moves the masses
+    VELOCITY_VERLET //second order, with velocities in step with positions
+};
+Integrator integrator = SEMI_IMPLICIT_EULER;
+bool auto_timestep = false; //give each robot a dt set by its fastest oscillation, see choose_timestep
+float fixed_timestep = 0; //dt asked for on the command line; 0 keeps the original 0.0001
+const float checkpoint_time = 0.005f; //simulated time between checkpoints, 50 steps of the original dt; a run is 300 of them
+const float steps_per_period = 25; //steps auto and adaptive dt spend on a period of the fastest oscillation
+const float ground_stiffness = 1000000.0f; //penalty per unit depth pushing a mass back out of the ground
+const float contact_height = 0.005f; //height under which a mass touches the ground, so one resting on the ground's penalty force does not flicker in and out of contact
+bool contact_friction = false; //--contact-friction: friction only for masses touching the ground; the original applies it to every mass, airborne or not, and its fitness depends on that
+bool single_precision = false; //run the step kernels as <float> rather than <double>, see update_forces
+bool adaptive_timestep = false; //pick every step's dt from the state, short only around ground contact, see adaptive_dt
+const float extension_tolerance = 0.05f; //fraction of an edge the two ends of a spring may close or open by in one adaptive step
+const float min_timestep = 0.0001f; //the original dt; adaptive steps never go below it
+const int batch_lanes = 16;
+constexpr int fixed_lanes[] = {batch_lanes, 8}; //batch widths with kernels compiled for exactly that many lanes; 8 is a single AVX register
+bool racing = false; //stop runs that cannot beat their incumbent, see out_of_race
+const int race_warmup = 100; //checkpoints before a run may be stopped; early on robots are still settling and speeding up
+const float race_margin = 4.0f; //how many times its fastest speed so far a robot is allowed to move for the rest of the run
+long race_steps_saved = 0;
+EvaluationPool evaluation_pool;
+FitnessCache fitness_cache; //only touched by the thread calling evaluate_jobs
+bool turn_shapes = false; //also count a shape turned about the vertical as the same robot, see hash_shape
+
+int robot_cubes = 14; //cubes per robot, which is also the number of equations in a controller
+int cut_point1 = 5; //crossover points, rescaled to robot_cubes in main
+int cut_point2 = 10;
 
-const int cut_point1 = 5;
-const int cut_point2 = 10;
+//the unit cube every cube is stamped from; vertices 0-3 are the bottom face and 4-7 the top, counterclockwise from front left
+constexpr float edge_length = 0.5f;
+constexpr float face_diagonal = 0.707106769f; //0.5f*sqrt(2.0f), the same float the springs were built with
+constexpr float body_diagonal = 0.866025388f; //0.5f*sqrt(3.0f)
 
-vector<int> face0 = {0, 1, 2, 3}; //face 0 (bottom face) corresponds with these cube vertices; only connects with face 5
-vector<int> face1 = {0, 3, 4, 7}; //face 1(front face) corresponds with these cube vertices; only connects with face 3
-vector<int> face2 = {0, 1, 4, 5}; //face 2 (left face) corresponds with these cube vertices; only connects with face 4
-vector<int> face3 = {1, 2, 5, 6}; //face 3 (back face) corrresponds with these cube vertices; only connects with face 1
-vector<int> face4 = {3, 2, 7, 6}; //face 4 (right face) corresponds with these cube vertices; only conncects with face 2
-vector<int> face5 = {4, 5, 6, 7}; //face 5 (top face) corresponds with these cube vertices; only connects with face 0
+struct UnitSpring{
+    int m0;
+    int m1;
+    float L0;
+};
+
+constexpr array<array<float, 3>, 8> unit_cube_vertices = {{
+    {-0.25f, -0.25f, 0.0f}, //bottom, front left
+    {-0.25f, 0.25f, 0.0f}, //bottom, back left
+    {0.25f, 0.25f, 0.0f}, //bottom, back right
+    {0.25f, -0.25f, 0.0f}, //bottom, front right
+    {-0.25f, -0.25f, 0.5f}, //top, front left
+    {-0.25f, 0.25f, 0.5f}, //top, back left
+    {0.25f, 0.25f, 0.5f}, //top, back right
+    {0.25f, -0.25f, 0.5f} //top, front right
+}};
+
+constexpr array<UnitSpring, 28> unit_cube_springs = {{
+    {0, 1, edge_length}, {1, 2, edge_length}, {2, 3, edge_length}, {3, 0, edge_length}, //bottom face
+    {0, 2, face_diagonal}, {1, 3, face_diagonal}, //cross springs of bottom face
+    {0, 4, edge_length}, {1, 5, edge_length}, {2, 6, edge_length}, {3, 7, edge_length}, //vertical supports
+    {0, 7, face_diagonal}, {3, 4, face_diagonal}, //cross springs of front face
+    {0, 5, face_diagonal}, {1, 4, face_diagonal}, //cross springs of left face
+    {1, 6, face_diagonal}, {2, 5, face_diagonal}, //cross springs of back face
+    {2, 7, face_diagonal}, {3, 6, face_diagonal}, //cross springs of right face
+    {4, 5, edge_length}, {5, 6, edge_length}, {6, 7, edge_length}, {7, 4, edge_length}, //top face
+    {4, 6, face_diagonal}, {5, 7, face_diagonal}, //cross springs of top face
+    {0, 6, body_diagonal}, {2, 4, body_diagonal}, {1, 7, body_diagonal}, {3, 5, body_diagonal} //inner cross springs
+}};
+
+//faces are 0 bottom, 1 front, 2 left, 3 back, 4 right, 5 top; a face only fuses with its opposite
+constexpr array<int, 6> opposite_face = {5, 3, 4, 1, 2, 0};
 
-vector<int> face0_springs = {0, 1, 2, 3, 4, 5}; //face 0 (bottom face) corresponds with these cube springs; only connects with face 5
-vector<int> face1_springs = {3, 6, 9, 10, 11, 21}; //face 1 (front face) corresponds with these cube springs; only connects with face 3
-vector<int> face2_springs = {0, 6, 7, 12, 13, 18}; //face 2 (left face) corresponds with these cube springs; only connects with face 4
-vector<int> face3_springs = {1, 7, 8, 14, 15, 19}; //face 3 (back face) corresponds with these cube springs; only connects with face 1
-vector<int> face4_springs = {2, 9, 8, 17, 16, 20}; //face 4 (right face) corresponds with these cube springs; only connects with face 2
-vector<int> face5_springs = {18, 19, 20, 21, 22, 23}; // face 5 (top face) corresponds with these cube springs; only connects with face 0
+constexpr array<array<int, 4>, 6> face_vertices = {{
+    {0, 1, 2, 3},
+    {0, 3, 4, 7},
+    {0, 1, 4, 5},
+    {1, 2, 5, 6},
+    {3, 2, 7, 6},
+    {4, 5, 6, 7}
+}}; //cube vertices on each face, ordered so vertex j of a face lands on vertex j of the opposite face it fuses with
+
+constexpr array<array<int, 6>, 6> face_springs = {{
+    {0, 1, 2, 3, 4, 5},
+    {3, 6, 9, 10, 11, 21},
+    {0, 6, 7, 12, 13, 18},
+    {1, 7, 8, 14, 15, 19},
+    {2, 9, 8, 17, 16, 20},
+    {18, 19, 20, 21, 22, 23}
+}}; //cube springs on each face, paired with the opposite face the same way
 
 vector<float> const_k = {1000, 5000, 5000, 10000};
 vector<float> const_a = {0.1, 0.12, 0.15};
@@ -107,51 +388,166 @@ vector<float> const_c = {0, M_PI};
 void initialize_masses(vector<PointMass> &masses);
 void initialize_springs(vector<Spring> &springs);
 void apply_force(vector<PointMass> &masses);
-void update_pos_vel_acc(Robot &robot);
-void update_forces(Robot &robot);
-void reset_forces(Robot &robot);
-void update_breathing(Robot &robot, Controller &control);
-void initialize_robot(Robot &robot);
+void build_sim_template(RobotBody &body);
+void copy_floats(const vector<float> &from, vector<float> &to);
+void load_sim_state(const SimState &initial, SimState &state);
+template<typename Real, typename State> const Real *mass_as(const State &state);
+template<typename Real> void update_pos_vel_acc(SimState &state, const SimContext &ctx);
+template<typename Real> void update_pos_vel_acc_verlet(SimState &state, const SimContext &ctx);
+template<typename Real> void integrate(SimState &state, const SimContext &ctx);
+void choose_timestep(SimContext &ctx, const RobotBody &body);
+float period_step(float omega2);
+float step_limit(float dt, float remaining);
+float adaptive_dt(const SimState &state, const SimTopology &topology, float remaining);
+void sync_cube_masses(vector<Cube> &all_cubes, vector<PointMass> &masses);
+template<typename Real> void update_forces(SimState &state, const SimContext &ctx);
+template<typename Real> void update_spring_forces(SimState &state);
+void reset_forces(SimState &state);
+void compile_actuation_plan(const RobotBody &body, ActuationPlan &plan);
+void build_batch_state(const RobotBody &body, int lanes, BatchState &batch);
+template<int Lanes> void update_breathing_batch(BatchState &batch, const ActuationPlan &plan, vector<const Controller*> &controls, const SimContext &ctx);
+template<typename Real, int Lanes> void update_forces_batch(BatchState &batch, const SimContext &ctx);
+template<typename Real, int Lanes> void update_pos_vel_acc_batch(BatchState &batch, const SimContext &ctx);
+template<typename Real, int Lanes> void update_pos_vel_acc_verlet_batch(BatchState &batch, const SimContext &ctx);
+template<typename Real, int Lanes> void integrate_batch(BatchState &batch, const SimContext &ctx);
+template<typename Real, int Lanes> void step_batch(BatchState &batch, const ActuationPlan &plan, vector<const Controller*> &controls, const SimContext &ctx);
+template<typename Real> BatchStep batch_step_as(int lanes);
+BatchStep batch_step(int lanes);
+void reset_forces_batch(BatchState &batch);
+void update_breathing(SimState &state, const ActuationPlan &plan, Controller &control, const SimContext &ctx);
+void build_phase_table(PhaseTable &phases, const Controller *const *controls, int lanes, int n_motors);
+void advance_phases(PhaseTable &phases, float T);
+void initialize_robot(Robot &robot, Rng &rng);
+const RobotBody &robot_body(Robot &robot);
+void build_body(vector<Placement> &genome, RobotBody &body, Rng *rng);
 void initialize_cube(Cube &cube);
-void fuse_faces(Cube &cube1, Cube &cube2, int cube1_index, int cube2_index, vector<PointMass> &masses, vector<Spring> &springs, int combine1, int combine2, vector<int> &masses_left, vector<int> &springs_left);
-void breed_robots(vector<Robot> &new_robot_population, Robot &robot1, Robot &robot2, vector<Controller> &population, vector<Controller> &major_league);
-void get_population(vector<Controller> &population, vector<Robot> &robot_population);
-void replenish_population(vector<Controller> &new_set, vector<Robot> &robot_population);
-void create_equation(Controller &control);
-void mutate(Controller &offspring);
+void fuse_faces(Cube &cube1, Cube &cube2, int cube1_index, int cube2_index, vector<PointMass> &masses, vector<Spring> &springs, int combine1, int combine2, CubeAssembly &assembly);
+int64_t voxel_key(int x, int y, int z);
+void grid_add(CubeGrid &grid, int64_t key, int cube);
+int nth_set_bit(uint32_t bits, int n);
+void pool_add(CubePool &pool, int cube);
+void pool_remove(CubePool &pool, int cube);
+void fuse_neighbors(vector<Cube> &all_cubes, Cube &cube, int cube1, int cube_index, BuildScratch &scratch, CubePool &available_cubes, vector<PointMass> &masses, vector<Spring> &springs, bool verbose);
+Robot breed_robots(Robot &robot1, Robot &robot2);
+void get_population(vector<Controller> &population, vector<Robot> &robot_population, Rng &rng);
+void replenish_population(vector<Controller> &new_set, vector<Robot> &robot_population, Rng &rng);
+void create_equation(Controller &control, Rng &rng);
+void mutate(Controller &offspring, Rng &rng);
 bool compareByFitness(const Controller &control1, const Controller &control2);
-float determine_fitness(Controller &control, Robot robot);
-void breed(vector<Controller> &new_population, Controller control1, Controller control2, vector<Robot> &robot_population);
-void get_robot_population(vector<Robot> &robot_population);
+float determine_fitness(Controller &control, const Robot &robot, float incumbent, int &steps_skipped);
+void determine_fitness_batch(FitnessJob *jobs, int lanes);
+bool out_of_race(float displacement, float speed, float &top_speed, int runs, float incumbent, const SimContext &ctx);
+void compact_batch(BatchState &batch, const vector<int> &keep);
+Controller breed(Controller &control1, Controller &control2, Rng &rng);
+void evaluate_controllers(vector<Controller> &controllers, vector<Robot> &robot_population, const vector<float> &parent_fitness);
+void evaluate_robots(vector<Robot> &robots, vector<Controller> &population, vector<Controller> &major_league, const vector<float> &parent_fitness);
+vector<float> robot_center(const Robot &robot);
+void start_evaluation_pool(int threads);
+void stop_evaluation_pool();
+void evaluation_worker();
+void run_jobs(unique_lock<mutex> &guard);
+void evaluate_jobs(vector<FitnessJob> &jobs);
+void simulate_jobs(vector<FitnessJob> &jobs);
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t bytes);
+uint64_t check_bytes(uint64_t hash, const void *data, size_t bytes);
+void hash_robot(const Robot &robot, FitnessKey &key);
+void hash_shape(RobotBody &body);
+uint64_t hash_key(const FitnessKey &key);
+bool same_key(const FitnessKey &key1, const FitnessKey &key2);
+bool cache_lookup(const FitnessKey &key, uint64_t hash, float &fitness);
+void cache_insert(const FitnessKey &key, uint64_t hash, float fitness);
+void get_robot_population(vector<Robot> &robot_population, Rng &rng);
 bool compareByFitnessR(const Robot &robot1, const Robot &robot2);
-void replenish_robot_population(vector<Robot> &new_robot_set, vector<Controller> &population, vector<Controller> &major_league);
+void replenish_robot_population(vector<Robot> &new_robot_set, vector<Controller> &population, vector<Controller> &major_league, Rng &rng);
+uint64_t splitmix64(uint64_t &x);
+void seed_rng(Rng &rng, uint64_t seed);
+uint64_t rotl(uint64_t x, int k);
+uint64_t next_random(Rng &rng);
+int random_int(Rng &rng, int n);
 
 
 int main(int argc, const char * argv[]) {
     // insert code here...
-    srand( static_cast<unsigned int>(time(0)));
     std::cout << "Hello, World!\n";
     
-    vector<Robot> robot_population;
-    
-    get_robot_population(robot_population);
-    
-    for (int q=0; q< robot_population.size(); q++){
-        float x_center = 0;
-        float y_center = 0;
-        float z_center = 0;
-        for (int m=0; m<robot_population[q].masses.size(); m++){
-            x_center += robot_population[q].masses[m].position[0];
-            y_center += robot_population[q].masses[m].position[1];
-            z_center += robot_population[q].masses[m].position[2];
+    int threads = thread::hardware_concurrency();
+    uint64_t seed = static_cast<uint64_t>(time(0));
+    for (int a=1; a<argc; a++){
+        if (string(argv[a]) == "--threads" && a+1 < argc){
+            threads = atoi(argv[++a]);
+        }
+        else if (string(argv[a]) == "--cubes" && a+1 < argc){
+            robot_cubes = max(atoi(argv[++a]), 2); //mutate swaps two different equations
+        }
+        else if (string(argv[a]) == "--seed" && a+1 < argc){
+            seed = strtoull(argv[++a], nullptr, 10);
+        }
+        else if (string(argv[a]) == "--contact-friction"){
+            contact_friction = true;
+        }
+        else if (string(argv[a]) == "--race"){
+            racing = true;
+        }
+        else if (string(argv[a]) == "--integrator" && a+1 < argc){
+            string name = argv[++a];
+            if (name == "verlet"){
+                integrator = VELOCITY_VERLET;
+            }
+            else if (name == "euler"){
+                integrator = SEMI_IMPLICIT_EULER;
+            }
+            else{
+                cerr << "--integrator takes euler or verlet, not " << name << endl;
+                return 1;
+            }
+        }
+        else if (string(argv[a]) == "--precision" && a+1 < argc){
+            single_precision = string(argv[++a]) == "float";
+        }
+        else if (string(argv[a]) == "--dt" && a+1 < argc){
+            string value = argv[++a];
+            if (value == "auto"){
+                auto_timestep = true;
+            }
+            else if (value == "adaptive"){
+                adaptive_timestep = true;
+                batching = false; //a batch would share one dt, so each lane's fitness would depend on its batch mates
+            }
+            else{
+                char *end;
+                fixed_timestep = strtof(value.c_str(), &end);
+                if (end == value.c_str() || *end != '\0' || !isfinite(fixed_timestep) || fixed_timestep <= 0){
+                    cerr << "--dt takes auto, adaptive or a step in seconds above 0, not " << value << endl;
+                    return 1;
+                }
+            }
+        }
+        else if (string(argv[a]) == "--cache" && a+1 < argc){
+            string value = argv[++a];
+            char *end;
+            unsigned long long capacity = strtoull(value.c_str(), &end, 10); //0 turns the fitness cache off
+            if (end == value.c_str() || *end != '\0' || value.find('-') != string::npos){
+                cerr << "--cache takes a number of entries, 0 or more, not " << value << endl;
+                return 1;
+            }
+            fitness_cache.capacity = capacity;
+        }
+        else if (string(argv[a]) == "--rotations"){
+            turn_shapes = true;
         }
-        
-        x_center = x_center/robot_population[q].masses.size();
-        y_center = y_center/robot_population[q].masses.size();
-        z_center = z_center/robot_population[q].masses.size();
-        
-        robot_population[q].center = {x_center, y_center, z_center};
     }
+    cut_point1 = robot_cubes*5/14;
+    cut_point2 = robot_cubes*10/14;
+    start_evaluation_pool(threads);
+    
+    //all randomness comes from here and only the main thread draws from it, so the seed alone fixes the run whatever the thread count
+    Rng rng;
+    seed_rng(rng, seed);
+    cout << "Seed = " << seed << endl;
+    
+    vector<Robot> robot_population;
+    
+    get_robot_population(robot_population, rng);
     
     cout<< "Initialized Robot Population" << endl;
     
@@ -159,7 +555,7 @@ int main(int argc, const char * argv[]) {
     vector<Controller> major_league;
     vector<Controller> update_major;
     
-    get_population(population, robot_population);
+    get_population(population, robot_population, rng);
     sort(population.begin(), population.end(), compareByFitness);
     sort(robot_population.begin(), robot_population.end(), compareByFitnessR);
     cout<< "Initialized Controller Population" << endl;
@@ -179,48 +575,85 @@ int main(int argc, const char * argv[]) {
         
         if (evaluations % 2 == 0){
             cout << "Evolving Robots Now" << endl;
+            vector<Robot> offspring;
+            vector<float> parent_fitness;
             for (int r=0; r<robot_population.size(); r++){
-                int parent2 = rand() % 10;
+                int parent2 = random_int(rng, 10);
                 if(parent2 == r){
                     bool same = true;
                     while(same){
-                        parent2 = rand() % 10;
+                        parent2 = random_int(rng, 10);
                         if(parent2 != r){
                             same = false;
                         }
                     }
                 }
-                breed_robots(new_robot_population, robot_population[r], robot_population[parent2], population, major_league);
+                offspring.push_back(breed_robots(robot_population[r], robot_population[parent2]));
+                parent_fitness.push_back(robot_population[r].fitness);
+            }
+            
+            evaluate_robots(offspring, population, major_league, parent_fitness);
+            
+            for (int r=0; r<robot_population.size(); r++){
+                if (offspring[r].fitness > robot_population[r].fitness){
+                    new_robot_population.push_back(offspring[r]);
+                }
+                else{
+                    new_robot_population.push_back(robot_population[r]);
+                }
             }
             robot_population = new_robot_population;
             sort(robot_population.begin(), robot_population.end(), compareByFitnessR);
         }
         else{
             cout << "Evolving Controller Now" << endl;
+            vector<Controller> offspring; //in breeding order, each major league offspring right after the little league one with the same index
+            vector<Controller> parents; //first parent of every offspring
+            vector<bool> from_major;
             for (int i=0; i<population.size(); i++){
-                int parent2 = rand() % 50;
+                int parent2 = random_int(rng, 50);
                 if(parent2 == i){
                     bool same = true;
                     while(same){
-                        parent2 = rand() % 50;
+                        parent2 = random_int(rng, 50);
                         if(parent2 != i){
                             same = false;
                         }
                     }
                 }
-                breed(new_population, population[i], population[parent2], robot_population);
+                offspring.push_back(breed(population[i], population[parent2], rng));
+                parents.push_back(population[i]);
+                from_major.push_back(false);
                 if (i < major_league.size() && major_league.size() > 0){
-                    int parent2_m2 = rand() % 25;
+                    int parent2_m2 = random_int(rng, 25);
                     if(parent2_m2 == i){
                         bool same = true;
                         while(same){
-                            parent2_m2 = rand() % 25;
+                            parent2_m2 = random_int(rng, 25);
                             if(parent2_m2 != i){
                                 same = false;
                             }
                         }
                     }
-                    breed(new_major, major_league[i], major_league[parent2_m2], robot_population);
+                    offspring.push_back(breed(major_league[i], major_league[parent2_m2], rng));
+                    parents.push_back(major_league[i]);
+                    from_major.push_back(true);
+                }
+            }
+            
+            vector<float> parent_fitness;
+            for (int o=0; o<parents.size(); o++){
+                parent_fitness.push_back(parents[o].fitness);
+            }
+            evaluate_controllers(offspring, robot_population, parent_fitness);
+            
+            for (int o=0; o<offspring.size(); o++){
+                vector<Controller> &league = from_major[o] ? new_major : new_population;
+                if (offspring[o].fitness > parents[o].fitness){
+                    league.push_back(offspring[o]);
+                }
+                else{
+                    league.push_back(parents[o]);
                 }
             }
             population = new_population;
@@ -247,7 +680,7 @@ int main(int argc, const char * argv[]) {
             population.erase(population.begin(), population.begin()+25);
             
             vector<Controller> new_set;
-            replenish_population(new_set, robot_population);
+            replenish_population(new_set, robot_population, rng);
             
             population.insert(population.end(), new_set.begin(), new_set.end());
             //-----------------------------------------------------------------------------------------
@@ -258,7 +691,7 @@ int main(int argc, const char * argv[]) {
             robot_population.erase(robot_population.begin()+5, robot_population.end());
             
             vector<Robot> new_robot_set;
-            replenish_robot_population(new_robot_set, population, major_league);
+            replenish_robot_population(new_robot_set, population, major_league, rng);
             
             robot_population.insert(robot_population.end(), new_robot_set.begin(), new_robot_set.end());
             //-----------------------------------------------------------------------------------------
@@ -269,6 +702,7 @@ int main(int argc, const char * argv[]) {
             sort(robot_population.begin(), robot_population.end(), compareByFitnessR);
         }
         
+        const RobotBody &shown = robot_body(robot_population[0]);
         for (int s=0; s < robot_population.size(); s++){
             cout << "ROBOT NUMBER = ";
             cout << s << endl;
@@ -294,13 +728,13 @@ int main(int argc, const char * argv[]) {
             
             cout << "ROBOT" << endl;
             cout << "-------------" << endl;
-            for (int l=0; l<robot_population[0].all_cubes.size(); l++){
+            for (int l=0; l<shown.all_cubes.size(); l++){
                 cout << "Cube Number = ";
                 cout << l << endl;
                 cout << "Fused to Cube = ";
-                for (int n=0; n<robot_population[0].all_cubes[l].joinedCubes.size(); n++){
-                    cout << robot_population[0].all_cubes[l].joinedCubes[n];
-                    if (n == robot_population[0].all_cubes[l].joinedCubes.size()-1){
+                for (int n=0; n<shown.all_cubes[l].joinedCubes.size(); n++){
+                    cout << shown.all_cubes[l].joinedCubes[n];
+                    if (n == shown.all_cubes[l].joinedCubes.size()-1){
                         cout << "; " << endl;
                     }
                     else{
@@ -308,9 +742,9 @@ int main(int argc, const char * argv[]) {
                     }
                 }
                 cout << "Its faces fused = ";
-                for (int n=0; n<robot_population[0].all_cubes[l].joinedFaces.size(); n++){
-                    cout << robot_population[0].all_cubes[l].joinedFaces[n];
-                    if (n == robot_population[0].all_cubes[l].joinedFaces.size()-1){
+                for (int n=0; n<shown.all_cubes[l].joinedFaces.size(); n++){
+                    cout << shown.all_cubes[l].joinedFaces[n];
+                    if (n == shown.all_cubes[l].joinedFaces.size()-1){
                         cout << "; " << endl;
                     }
                     else{
@@ -325,115 +759,112 @@ int main(int argc, const char * argv[]) {
         
         cout << "EVALUATIONS = ";
         cout << evaluations << endl;
+        
+        cout << "FITNESS CACHE HITS = ";
+        cout << fitness_cache.hits;
+        cout << ", MISSES = ";
+        cout << fitness_cache.misses << endl;
+        if (racing){
+            cout << "RACING STEPS SAVED = ";
+            cout << race_steps_saved << endl;
+        }
     }
 
+    stop_evaluation_pool();
     
     return 0;
 }
 
+//RANDOM NUMBERS
+//-----------------------------------------------------------------------
+uint64_t splitmix64(uint64_t &x){
+    x += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = x;
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+void seed_rng(Rng &rng, uint64_t seed){
+    //splitmix64 spreads the seed over the whole state, so nearby seeds give unrelated runs
+    for (int i=0; i<4; i++){
+        rng.s[i] = splitmix64(seed);
+    }
+}
+
+uint64_t rotl(uint64_t x, int k){
+    return (x << k) | (x >> (64-k));
+}
+
+uint64_t next_random(Rng &rng){
+    //xoshiro256**
+    uint64_t result = rotl(rng.s[1]*5, 7)*9;
+    uint64_t t = rng.s[1] << 17;
+    rng.s[2] ^= rng.s[0];
+    rng.s[3] ^= rng.s[1];
+    rng.s[1] ^= rng.s[2];
+    rng.s[0] ^= rng.s[3];
+    rng.s[2] ^= t;
+    rng.s[3] = rotl(rng.s[3], 45);
+    return result;
+}
+
+int random_int(Rng &rng, int n){
+    //uniform in [0, n), scaling the top 32 bits instead of taking a remainder
+    return (int)(((next_random(rng) >> 32)*(uint64_t)n) >> 32);
+}
+//-----------------------------------------------------------------------
+
 //EVOLVING CONTROLLER HERE
 //-----------------------------------------------------------------------
-void get_population(vector<Controller> &population, vector<Robot> &robot_population){
+void get_population(vector<Controller> &population, vector<Robot> &robot_population, Rng &rng){
     int individuals = 0;
     
     while (individuals < 50) {
-        cout << "New Controller" << endl;
         Controller control;
-        create_equation(control);
-        
-        for (int r=0; r<robot_population.size(); r++){
-            cout << "Testing Robot = ";
-            cout << r << endl;
-            float x_center = 0;
-            float y_center = 0;
-            float z_center = 0;
-            for (int m=0; m<robot_population[r].masses.size(); m++){
-                x_center += robot_population[r].masses[m].position[0];
-                y_center += robot_population[r].masses[m].position[1];
-                z_center += robot_population[r].masses[m].position[2];
-            }
-            
-            x_center = x_center/robot_population[r].masses.size();
-            y_center = y_center/robot_population[r].masses.size();
-            z_center = z_center/robot_population[r].masses.size();
-            
-            control.start = {x_center, y_center, z_center};
-            
-            float f = determine_fitness(control, robot_population[r]);
-            
-            if (f > control.fitness){
-                control.fitness = f;
-            }
-            if (f > robot_population[r].fitness){
-                robot_population[r].fitness = f;
-                robot_population[r].best_controller = control;
-            }
-        }
-        
-        cout << "Fitness = ";
-        cout << control.fitness << endl;
+        create_equation(control, rng);
         
         population.push_back(control);
         individuals += 1;
     }
+    
+    evaluate_controllers(population, robot_population, {});
+    
+    for (int i=0; i<population.size(); i++){
+        cout << "New Controller" << endl;
+        cout << "Fitness = ";
+        cout << population[i].fitness << endl;
+    }
 }
 
-void replenish_population(vector<Controller> &new_set, vector<Robot> &robot_population){
+void replenish_population(vector<Controller> &new_set, vector<Robot> &robot_population, Rng &rng){
     int individuals = 0;
     
     while (individuals < 25) {
-        cout << "Replenishing Controller Population..." << endl;
         Controller control;
-        create_equation(control);
-        
-        for (int r=0; r<robot_population.size(); r++){
-            float x_center = 0;
-            float y_center = 0;
-            float z_center = 0;
-            for (int m=0; m<robot_population[r].masses.size(); m++){
-                x_center += robot_population[r].masses[m].position[0];
-                y_center += robot_population[r].masses[m].position[1];
-                z_center += robot_population[r].masses[m].position[2];
-            }
-            
-            x_center = x_center/robot_population[r].masses.size();
-            y_center = y_center/robot_population[r].masses.size();
-            z_center = z_center/robot_population[r].masses.size();
-            
-            cout << "Center = ";
-            cout << x_center;
-            cout << ", ";
-            cout << y_center;
-            cout << ", ";
-            cout << z_center << endl;
-            
-            control.start = {x_center, y_center, z_center};
-            
-            float f = determine_fitness(control, robot_population[r]);
-            
-            if (f > control.fitness){
-                control.fitness = f;
-            }
-            if (f > robot_population[r].fitness){
-                robot_population[r].fitness = f;
-                robot_population[r].best_controller = control;
-            }
-        }
-        cout << "Fitness = ";
-        cout << control.fitness << endl;
+        create_equation(control, rng);
         
         new_set.push_back(control);
         individuals += 1;
     }
+    
+    evaluate_controllers(new_set, robot_population, {});
+    
+    for (int i=0; i<new_set.size(); i++){
+        cout << "Replenishing Controller Population..." << endl;
+        cout << "Fitness = ";
+        cout << new_set[i].fitness << endl;
+    }
 }
 
-void create_equation(Controller &control){
-    for (int i=0; i<14; i++){
+void create_equation(Controller &control, Rng &rng){
+    control.motor.reserve(robot_cubes);
+    for (int i=0; i<robot_cubes; i++){
         Equation eqn;
-        int rand1 = rand() % 4;
-        int rand2 = rand() % 3;
-        int rand3 = rand() % 2;
-        int rand4 = rand() % 2;
+        int rand1 = random_int(rng, 4);
+        int rand2 = random_int(rng, 3);
+        int rand3 = random_int(rng, 2);
+        int rand4 = random_int(rng, 2);
         
         eqn.k = const_k[rand1];
         if (rand1 == 0){
@@ -456,56 +887,197 @@ void create_equation(Controller &control){
     }
 }
 
-float determine_fitness(Controller &control, Robot robot){
+float determine_fitness(Controller &control, const Robot &robot, float incumbent, int &steps_skipped){
     float displacement = 0;
     int runs = 0;
-    T = 0;
+    SimContext ctx;
+    ctx.contact_margin = contact_friction ? contact_height : INFINITY;
+    float top_speed = 0;
+    
+    const RobotBody &body = *robot.body;
+    const ActuationPlan &plan = body.plan;
+    thread_local SimState state; //one buffer per thread, so runs on robots of a size already seen allocate nothing
+    load_sim_state(body.initial, state);
+    choose_timestep(ctx, body);
+    const Controller *controls = &control;
+    build_phase_table(state.phases, &controls, 1, plan.n_motors);
     
     while (runs < 300){
         
         //Let's test the controller
         //-------------------------------------
-        for (int k=0; k<50; k++){
-            T = T + dt; //update time that has passed
+        float remaining = checkpoint_time; //simulated time left to this checkpoint, for adaptive steps
+        int k;
+        for (k=0; adaptive_timestep ? remaining > 0 : k<ctx.steps_per_run; k++){
+            if (adaptive_timestep){
+                ctx.dt = adaptive_dt(state, body.topology, remaining);
+                remaining -= ctx.dt;
+            }
+            ctx.T = ctx.T + ctx.dt; //update time that has passed
             if (breathing) {
-                update_breathing(robot, control);
+                update_breathing(state, plan, control, ctx);
             }
 
-            update_forces(robot);
-            update_pos_vel_acc(robot);
+            if (single_precision){
+                update_forces<float>(state, ctx);
+                integrate<float>(state, ctx);
+            }
+            else{
+                update_forces<double>(state, ctx);
+                integrate<double>(state, ctx);
+            }
             
-            reset_forces(robot);
+            reset_forces(state);
             
         }
         //-------------------------------------
         
+        if (adaptive_timestep){
+            ctx.steps_per_run = k; //what racing counts as the steps each skipped checkpoint would have taken
+        }
         runs += 1;
+        
+        if (racing && incumbent >= 0){
+            double x_center = 0;
+            double y_center = 0;
+            double x_speed = 0;
+            double y_speed = 0;
+            for (int m=0; m<state.n_masses; m++){
+                x_center += state.px[m];
+                y_center += state.py[m];
+                x_speed += state.vx[m];
+                y_speed += state.vy[m];
+            }
+            float so_far = sqrt(pow(x_center/state.n_masses-control.start[0], 2) + pow(y_center/state.n_masses-control.start[1], 2));
+            float speed = sqrt(pow(x_speed/state.n_masses, 2) + pow(y_speed/state.n_masses, 2));
+            if (out_of_race(so_far, speed, top_speed, runs, incumbent, ctx)){
+                steps_skipped = (300-runs)*ctx.steps_per_run;
+                return so_far;
+            }
+        }
     }
-    float x_center = 0;
-    float y_center = 0;
-    float z_center = 0;
-    for (int m=0; m<robot.masses.size(); m++){
-        x_center += robot.masses[m].position[0];
-        y_center += robot.masses[m].position[1];
-        z_center += robot.masses[m].position[2];
+    double x_center = 0; //centers are summed in double whatever the kernels ran at, so rounding over many masses does not swamp a small displacement
+    double y_center = 0;
+    double z_center = 0;
+    for (int m=0; m<state.n_masses; m++){
+        x_center += state.px[m];
+        y_center += state.py[m];
+        z_center += state.pz[m];
     }
     
-    x_center = x_center/robot.masses.size();
-    y_center = y_center/robot.masses.size();
-    z_center = z_center/robot.masses.size();
+    x_center = x_center/state.n_masses;
+    y_center = y_center/state.n_masses;
+    z_center = z_center/state.n_masses;
     
-    control.end = {x_center, y_center, z_center};
+    control.end = {(float)x_center, (float)y_center, (float)z_center};
     
-    displacement = sqrt(pow(control.end[0]-control.start[0], 2) + pow(control.end[1]-control.start[1], 2));
+    displacement = sqrt(pow(x_center-control.start[0], 2) + pow(y_center-control.start[1], 2)); //from the double centers, as determine_fitness_batch does
     
     return displacement;
 }
 
-void breed(vector<Controller> &new_population, Controller control1, Controller control2, vector<Robot> &robot_population){
+void determine_fitness_batch(FitnessJob *jobs, int lanes){
+    //same simulation as determine_fitness for lanes jobs that share one robot, stepped together
+    const Robot &robot = *jobs[0].robot;
+    vector<float> start = robot_center(robot);
+    int runs = 0;
+    SimContext ctx;
+    ctx.contact_margin = contact_friction ? contact_height : INFINITY;
+    
+    const ActuationPlan &plan = robot.body->plan;
+    thread_local BatchState batch; //reused by every batch this thread runs
+    build_batch_state(*robot.body, lanes, batch);
+    choose_timestep(ctx, *robot.body);
+    
+    vector<const Controller*> controls;
+    vector<FitnessJob*> lane_jobs; //job simulated in each lane; racing drops lanes, so this stops matching jobs
+    vector<float> top_speed(lanes, 0.0f);
+    for (int l=0; l<lanes; l++){
+        controls.push_back(jobs[l].control);
+        lane_jobs.push_back(&jobs[l]);
+    }
+    build_phase_table(batch.phases, controls.data(), lanes, plan.n_motors);
+    
+    while (runs < 300 && batch.lanes > 0){
+        for (int k=0; k<ctx.steps_per_run; k++){
+            ctx.T = ctx.T + ctx.dt; //update time that has passed
+            batch.step(batch, plan, controls, ctx);
+        }
+        runs += 1;
+        
+        if (racing){
+            int live = batch.lanes;
+            vector<double> x_center(live, 0.0), y_center(live, 0.0), x_speed(live, 0.0), y_speed(live, 0.0);
+            for (int m=0; m<batch.n_masses; m++){
+                for (int l=0; l<live; l++){
+                    x_center[l] += batch.px[m*live+l];
+                    y_center[l] += batch.py[m*live+l];
+                    x_speed[l] += batch.vx[m*live+l];
+                    y_speed[l] += batch.vy[m*live+l];
+                }
+            }
+            
+            vector<int> keep;
+            for (int l=0; l<live; l++){
+                FitnessJob &job = *lane_jobs[l];
+                float so_far = sqrt(pow(x_center[l]/batch.n_masses-start[0], 2) + pow(y_center[l]/batch.n_masses-start[1], 2));
+                float speed = sqrt(pow(x_speed[l]/batch.n_masses, 2) + pow(y_speed[l]/batch.n_masses, 2));
+                if (job.incumbent >= 0 && out_of_race(so_far, speed, top_speed[l], runs, job.incumbent, ctx)){
+                    job.fitness = so_far;
+                    job.steps_skipped = (300-runs)*ctx.steps_per_run;
+                }
+                else{
+                    keep.push_back(l);
+                }
+            }
+            
+            if ((int)keep.size() < live){
+                //close the gaps so the stopped lanes cost nothing from here on
+                compact_batch(batch, keep);
+                for (int l=0; l<keep.size(); l++){
+                    controls[l] = controls[keep[l]];
+                    lane_jobs[l] = lane_jobs[keep[l]];
+                    top_speed[l] = top_speed[keep[l]];
+                }
+                controls.resize(keep.size());
+                lane_jobs.resize(keep.size());
+                top_speed.resize(keep.size());
+                build_phase_table(batch.phases, controls.data(), batch.lanes, plan.n_motors);
+            }
+        }
+    }
+    
+    for (int l=0; l<batch.lanes; l++){
+        double x_center = 0;
+        double y_center = 0;
+        for (int m=0; m<batch.n_masses; m++){
+            x_center += batch.px[m*batch.lanes+l];
+            y_center += batch.py[m*batch.lanes+l];
+        }
+        
+        x_center = x_center/batch.n_masses;
+        y_center = y_center/batch.n_masses;
+        
+        lane_jobs[l]->fitness = sqrt(pow(x_center-start[0], 2) + pow(y_center-start[1], 2));
+    }
+}
+
+bool out_of_race(float displacement, float speed, float &top_speed, int runs, float incumbent, const SimContext &ctx){
+    //called at every checkpoint; after the warmup a run is stopped once moving race_margin times its fastest speed so far for the rest of the run still could not beat the incumbent
+    top_speed = max(top_speed, speed);
+    if (runs < race_warmup){
+        return false;
+    }
+    float time_left = adaptive_timestep ? (300-runs)*checkpoint_time : (300-runs)*ctx.steps_per_run*ctx.dt;
+    return displacement + race_margin*top_speed*time_left <= incumbent;
+}
+
+Controller breed(Controller &control1, Controller &control2, Rng &rng){
     Controller offspring;
     
     bool recomb = false;
-    for (int i=0; i<14; i++){
+    offspring.motor.reserve(robot_cubes);
+    for (int i=0; i<robot_cubes; i++){
         if (i==cut_point1){
             recomb = true;
         }
@@ -521,55 +1093,22 @@ void breed(vector<Controller> &new_population, Controller control1, Controller c
     }
     
     
-    int rand1 = rand() % 100;
+    int rand1 = random_int(rng, 100);
     
     if (rand1 < 50){
-        mutate(offspring);
-    }
-    
-    for (int r=0; r<robot_population.size(); r++) {
-        float x_center = 0;
-        float y_center = 0;
-        float z_center = 0;
-        for (int m=0; m<robot_population[r].masses.size(); m++){
-            x_center += robot_population[r].masses[m].position[0];
-            y_center += robot_population[r].masses[m].position[1];
-            z_center += robot_population[r].masses[m].position[2];
-        }
-        
-        x_center = x_center/robot_population[r].masses.size();
-        y_center = y_center/robot_population[r].masses.size();
-        z_center = z_center/robot_population[r].masses.size();
-        
-        offspring.start = {x_center, y_center, z_center};
-        
-        float f = determine_fitness(offspring, robot_population[r]);
-        
-        if (f > offspring.fitness){
-            offspring.fitness = f;
-        }
-        if (f > robot_population[r].fitness){
-            robot_population[r].fitness = f;
-            robot_population[r].best_controller = offspring;
-        }
-    }
-    
-    if (offspring.fitness > control1.fitness){
-        new_population.push_back(offspring);
-    }
-    else{
-        new_population.push_back(control1);
+        mutate(offspring, rng);
     }
     
+    return offspring;
 }
 
-void mutate(Controller &offspring){
-    int rand_num = rand() % 14;
-    int rand_num2 = rand() % 14;
+void mutate(Controller &offspring, Rng &rng){
+    int rand_num = random_int(rng, robot_cubes);
+    int rand_num2 = random_int(rng, robot_cubes);
     if(rand_num2 == rand_num){
         bool same = true;
         while(same){
-            rand_num2 = rand() % 14;
+            rand_num2 = random_int(rng, robot_cubes);
             if(rand_num2 != rand_num){
                 same = false;
             }
@@ -580,907 +1119,1440 @@ void mutate(Controller &offspring){
 }
 //-----------------------------------------------------------------------
 
-//POSITION, FORCE CALCULATIONS, AND CONTROLLER IMPLEMENTATION OCCUR HERE AND BELOW
+//PARALLEL FITNESS EVALUATION HAPPENS HERE
 //-----------------------------------------------------------------------
-void update_breathing(Robot &robot, Controller &control){
-    for (int i=0; i<robot.all_cubes.size(); i++){
-        int ind0 = robot.all_cubes[i].springIDs[0];
-        int ind1 = robot.all_cubes[i].springIDs[1];
-        int ind2 = robot.all_cubes[i].springIDs[2];
-        int ind3 = robot.all_cubes[i].springIDs[3];
-        int ind4 = robot.all_cubes[i].springIDs[4];
-        int ind5 = robot.all_cubes[i].springIDs[5];
-        int ind6 = robot.all_cubes[i].springIDs[6];
-        int ind7 = robot.all_cubes[i].springIDs[7];
-        int ind8 = robot.all_cubes[i].springIDs[8];
-        int ind9 = robot.all_cubes[i].springIDs[9];
-        int ind10 = robot.all_cubes[i].springIDs[10];
-        int ind11 = robot.all_cubes[i].springIDs[11];
-        int ind12 = robot.all_cubes[i].springIDs[12];
-        int ind13 = robot.all_cubes[i].springIDs[13];
-        int ind14 = robot.all_cubes[i].springIDs[14];
-        int ind15 = robot.all_cubes[i].springIDs[15];
-        int ind16 = robot.all_cubes[i].springIDs[16];
-        int ind17 = robot.all_cubes[i].springIDs[17];
-        int ind18 = robot.all_cubes[i].springIDs[18];
-        int ind19 = robot.all_cubes[i].springIDs[19];
-        int ind20 = robot.all_cubes[i].springIDs[20];
-        int ind21 = robot.all_cubes[i].springIDs[21];
-        int ind22 = robot.all_cubes[i].springIDs[22];
-        int ind23 = robot.all_cubes[i].springIDs[23];
-        int ind24 = robot.all_cubes[i].springIDs[24];
-        int ind25 = robot.all_cubes[i].springIDs[25];
-        int ind26 = robot.all_cubes[i].springIDs[26];
-        int ind27 = robot.all_cubes[i].springIDs[27];
-
-        float k = control.motor[i].k;
-        float a = control.motor[i].a;
-        float w = control.motor[i].w;
-        float c = control.motor[i].c;
-
-        for (int k=0; k<28; k++){
-            if (robot.all_cubes[i].springs[k].ID == ind0){
-                robot.springs[ind0].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind1){
-                robot.springs[ind1].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind2){
-                robot.springs[ind2].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind3){
-                robot.springs[ind3].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind4){
-                robot.springs[ind4].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind5){
-                robot.springs[ind5].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind6){
-                robot.springs[ind6].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind7){
-                robot.springs[ind7].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind8){
-                robot.springs[ind8].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind9){
-                robot.springs[ind9].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind10){
-                robot.springs[ind10].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind11){
-                robot.springs[ind11].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind12){
-                robot.springs[ind12].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind13){
-                robot.springs[ind13].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind14){
-                robot.springs[ind14].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind15){
-                robot.springs[ind15].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind16){
-                robot.springs[ind16].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind17){
-                robot.springs[ind17].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
+void evaluate_controllers(vector<Controller> &controllers, vector<Robot> &robot_population, const vector<float> &parent_fitness){
+    //tests every controller on every robot, then folds the results back in the same order the serial loops used
+    //jobs are queued robot by robot so the controllers sharing a robot can be batched
+    //parent_fitness holds the fitness each offspring has to beat, or is empty when every fitness is needed exactly
+    vector<FitnessJob> jobs;
+    for (int r=0; r<robot_population.size(); r++){
+        robot_body(robot_population[r]); //decoded here, before the workers share it
+        for (int i=0; i<controllers.size(); i++){
+            FitnessJob job;
+            job.control = &controllers[i];
+            job.robot = &robot_population[r];
+            if (!parent_fitness.empty()){
+                //a result that beats neither the parent nor the robot's best changes nothing
+                job.incumbent = min(parent_fitness[i], robot_population[r].fitness);
+            }
+            jobs.push_back(job);
+        }
+    }
+    
+    evaluate_jobs(jobs);
+    
+    for (int i=0; i<controllers.size(); i++){
+        for (int r=0; r<robot_population.size(); r++){
+            float f = jobs[r*controllers.size()+i].fitness;
+            
+            if (f > controllers[i].fitness){
+                controllers[i].fitness = f;
             }
-            else if (robot.all_cubes[i].springs[k].ID == ind18){
-                robot.springs[ind18].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
+            if (f > robot_population[r].fitness){
+                robot_population[r].fitness = f;
+                robot_population[r].best_controller = controllers[i];
             }
-            else if (robot.all_cubes[i].springs[k].ID == ind19){
-                robot.springs[ind19].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
+        }
+    }
+}
+
+void evaluate_robots(vector<Robot> &robots, vector<Controller> &population, vector<Controller> &major_league, const vector<float> &parent_fitness){
+    //tests every robot on the little league and then the major league, folding the results back in serial order
+    //parent_fitness holds the fitness each offspring robot has to beat, or is empty when every fitness is needed exactly
+    vector<FitnessJob> jobs;
+    for (int r=0; r<robots.size(); r++){
+        robot_body(robots[r]); //decoded here, before the workers share it
+        for (int c=0; c<population.size(); c++){
+            FitnessJob job;
+            job.control = &population[c];
+            job.robot = &robots[r];
+            if (!parent_fitness.empty()){
+                job.incumbent = min(parent_fitness[r], population[c].fitness);
             }
-            else if (robot.all_cubes[i].springs[k].ID == ind20){
-                robot.springs[ind20].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
+            jobs.push_back(job);
+        }
+        for (int m=0; m<major_league.size(); m++){
+            FitnessJob job;
+            job.control = &major_league[m];
+            job.robot = &robots[r];
+            if (!parent_fitness.empty()){
+                job.incumbent = min(parent_fitness[r], major_league[m].fitness);
             }
-            else if (robot.all_cubes[i].springs[k].ID == ind21){
-                robot.springs[ind21].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
+            jobs.push_back(job);
+        }
+    }
+    
+    evaluate_jobs(jobs);
+    
+    int j = 0;
+    for (int r=0; r<robots.size(); r++){
+        for (int c=0; c<population.size(); c++){
+            float f = jobs[j].fitness;
+            j += 1;
+            
+            if (f > robots[r].fitness){
+                robots[r].fitness = f;
+                robots[r].best_controller = population[c];
             }
-            else if (robot.all_cubes[i].springs[k].ID == ind22){
-                robot.springs[ind22].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
+            if (f > population[c].fitness){
+                population[c].fitness = f;
             }
-            else if (robot.all_cubes[i].springs[k].ID == ind23){
-                robot.springs[ind23].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
+        }
+        for (int m=0; m<major_league.size(); m++){
+            float f = jobs[j].fitness;
+            j += 1;
+            
+            if (f > robots[r].fitness){
+                robots[r].fitness = f;
+                robots[r].best_controller = major_league[m];
             }
-            else if (robot.all_cubes[i].springs[k].ID == ind24){
-                robot.springs[ind24].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind25){
-                robot.springs[ind25].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind26){
-                robot.springs[ind26].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
-            }
-            else if (robot.all_cubes[i].springs[k].ID == ind27){
-                robot.springs[ind27].L0 = robot.all_cubes[i].springs[k].original_L0 + a*sin(w*T+c);;
+            if (f > major_league[m].fitness){
+                major_league[m].fitness = f;
             }
         }
+    }
+}
 
-        robot.springs[ind0].k = k;
-        robot.springs[ind1].k = k;
-        robot.springs[ind2].k = k;
-        robot.springs[ind3].k = k;
-        robot.springs[ind4].k = k;
-        robot.springs[ind5].k = k;
-        robot.springs[ind6].k = k;
-        robot.springs[ind7].k = k;
-        robot.springs[ind8].k = k;
-        robot.springs[ind9].k = k;
-        robot.springs[ind10].k = k;
-        robot.springs[ind11].k = k;
-        robot.springs[ind12].k = k;
-        robot.springs[ind13].k = k;
-        robot.springs[ind14].k = k;
-        robot.springs[ind15].k = k;
-        robot.springs[ind16].k = k;
-        robot.springs[ind17].k = k;
-        robot.springs[ind18].k = k;
-        robot.springs[ind19].k = k;
-        robot.springs[ind20].k = k;
-        robot.springs[ind21].k = k;
-        robot.springs[ind22].k = k;
-        robot.springs[ind23].k = k;
-        robot.springs[ind24].k = k;
-        robot.springs[ind25].k = k;
-        robot.springs[ind26].k = k;
-        robot.springs[ind27].k = k;
-    }
-}
-
-void update_pos_vel_acc(Robot &robot){
-    
-    for (int i=0; i<robot.masses.size(); i++){
-        float acc_x = robot.masses[i].forces[0]/robot.masses[i].mass;
-        float acc_y = robot.masses[i].forces[1]/robot.masses[i].mass;
-        float acc_z = robot.masses[i].forces[2]/robot.masses[i].mass;
-
-        robot.masses[i].acceleration[0] = acc_x;
-        robot.masses[i].acceleration[1] = acc_y;
-        robot.masses[i].acceleration[2] = acc_z;
-        
-        float vel_x = acc_x*dt + robot.masses[i].velocity[0];
-        float vel_y = acc_y*dt + robot.masses[i].velocity[1];
-        float vel_z = acc_z*dt + robot.masses[i].velocity[2];
+vector<float> robot_center(const Robot &robot){
+    const RobotBody &body = *robot.body;
+    double x_center = 0;
+    double y_center = 0;
+    double z_center = 0;
+    for (int m=0; m<body.masses.size(); m++){
+        x_center += body.masses[m].position[0];
+        y_center += body.masses[m].position[1];
+        z_center += body.masses[m].position[2];
+    }
+    
+    x_center = x_center/body.masses.size();
+    y_center = y_center/body.masses.size();
+    z_center = z_center/body.masses.size();
+    
+    return {(float)x_center, (float)y_center, (float)z_center};
+}
+
+void start_evaluation_pool(int threads){
+    //the thread calling evaluate_jobs also runs jobs, so only threads-1 workers are started
+    for (int t=1; t<threads; t++){
+        evaluation_pool.workers.push_back(thread(evaluation_worker));
+    }
+}
+
+void stop_evaluation_pool(){
+    {
+        lock_guard<mutex> guard(evaluation_pool.lock);
+        evaluation_pool.stopping = true;
+    }
+    evaluation_pool.wake.notify_all();
+    for (int t=0; t<evaluation_pool.workers.size(); t++){
+        evaluation_pool.workers[t].join();
+    }
+    evaluation_pool.workers.clear();
+}
+
+void evaluation_worker(){
+    unique_lock<mutex> guard(evaluation_pool.lock);
+    while (!evaluation_pool.stopping){
+        run_jobs(guard);
+        evaluation_pool.wake.wait(guard);
+    }
+}
+
+void run_jobs(unique_lock<mutex> &guard){
+    //claims tasks of the current batch until none are left; the pool lock is held on entry and on return
+    while (evaluation_pool.jobs != nullptr && evaluation_pool.next_task+1 < evaluation_pool.task_first.size()){
+        int first = evaluation_pool.task_first[evaluation_pool.next_task];
+        int count = evaluation_pool.task_first[evaluation_pool.next_task+1]-first;
+        FitnessJob *jobs = &(*evaluation_pool.jobs)[first];
+        evaluation_pool.next_task += 1;
+        guard.unlock();
         
+        if (count == 1){
+            Controller control = *jobs[0].control; //determine_fitness writes start/end, so every job works on its own copy
+            control.start = robot_center(*jobs[0].robot);
+            jobs[0].fitness = determine_fitness(control, *jobs[0].robot, jobs[0].incumbent, jobs[0].steps_skipped);
+        }
+        else{
+            determine_fitness_batch(jobs, count);
+        }
         
-        robot.masses[i].velocity[0] = vel_x*b;
-        robot.masses[i].velocity[1] = vel_y*b;
-        robot.masses[i].velocity[2] = vel_z*b;
+        guard.lock();
+        evaluation_pool.jobs_done += count;
+        if (evaluation_pool.jobs_done == evaluation_pool.jobs->size()){
+            evaluation_pool.finished.notify_all();
+        }
+    }
+}
+
+void evaluate_jobs(vector<FitnessJob> &jobs){
+    //answers what it can from the fitness cache, simulates each remaining distinct job once, then caches the new results
+    vector<FitnessKey> keys(jobs.size());
+    vector<uint64_t> hashes(jobs.size());
+    vector<int> source(jobs.size(), -1); //index into pending of the simulation that answers each uncached job
+    vector<FitnessJob> pending;
+    vector<int> pending_job; //job each pending simulation was made for
+    unordered_map<uint64_t, int> pending_index;
+    
+    for (int j=0; j<jobs.size(); j++){
+        if (j > 0 && jobs[j].robot == jobs[j-1].robot){
+            keys[j].robot_hash = keys[j-1].robot_hash;
+            keys[j].robot_check = keys[j-1].robot_check;
+        }
+        else{
+            hash_robot(*jobs[j].robot, keys[j]);
+        }
+        keys[j].motor = jobs[j].control->motor;
+        hashes[j] = hash_key(keys[j]);
         
-        float pos_x = (vel_x*dt) + robot.masses[i].position[0];
-        float pos_y = (vel_y*dt) + robot.masses[i].position[1];
-        float pos_z = (vel_z*dt) + robot.masses[i].position[2];
+        if (cache_lookup(keys[j], hashes[j], jobs[j].fitness)){
+            fitness_cache.hits += 1;
+            continue;
+        }
         
-        robot.masses[i].position[0] = pos_x;
-        robot.masses[i].position[1] = pos_y;
-        robot.masses[i].position[2] = pos_z;
-    }
-    
-    for (int j=0; j<robot.all_cubes.size(); j++){
-        int ind0 = robot.all_cubes[j].massIDs[0];
-        int ind1 = robot.all_cubes[j].massIDs[1];
-        int ind2 = robot.all_cubes[j].massIDs[2];
-        int ind3 = robot.all_cubes[j].massIDs[3];
-        int ind4 = robot.all_cubes[j].massIDs[4];
-        int ind5 = robot.all_cubes[j].massIDs[5];
-        int ind6 = robot.all_cubes[j].massIDs[6];
-        int ind7 = robot.all_cubes[j].massIDs[7];
+        //the same pair can show up twice in one batch, e.g. an offspring that reproduced its parent
+        auto found = pending_index.find(hashes[j]);
+        if (found != pending_index.end() && same_key(keys[pending_job[found->second]], keys[j])){
+            source[j] = found->second;
+            FitnessJob &run = pending[found->second];
+            if (jobs[j].incumbent < run.incumbent){
+                run.incumbent = jobs[j].incumbent; //a stopped run still has to lose to every job it answers
+            }
+            fitness_cache.hits += 1;
+            continue;
+        }
         
-        for (int k=0; k<8; k++){
-            if (robot.all_cubes[j].masses[k].ID == ind0){
-                robot.all_cubes[j].masses[k].position[0] = robot.masses[ind0].position[0];
-                robot.all_cubes[j].masses[k].position[1] = robot.masses[ind0].position[1];
-                robot.all_cubes[j].masses[k].position[2] = robot.masses[ind0].position[2];
-            }
-            else if (robot.all_cubes[j].masses[k].ID == ind1){
-                robot.all_cubes[j].masses[k].position[0] = robot.masses[ind1].position[0];
-                robot.all_cubes[j].masses[k].position[1] = robot.masses[ind1].position[1];
-                robot.all_cubes[j].masses[k].position[2] = robot.masses[ind1].position[2];
-            }
-            else if (robot.all_cubes[j].masses[k].ID == ind2){
-                robot.all_cubes[j].masses[k].position[0] = robot.masses[ind2].position[0];
-                robot.all_cubes[j].masses[k].position[1] = robot.masses[ind2].position[1];
-                robot.all_cubes[j].masses[k].position[2] = robot.masses[ind2].position[2];
-            }
-            else if (robot.all_cubes[j].masses[k].ID == ind3){
-                robot.all_cubes[j].masses[k].position[0] = robot.masses[ind3].position[0];
-                robot.all_cubes[j].masses[k].position[1] = robot.masses[ind3].position[1];
-                robot.all_cubes[j].masses[k].position[2] = robot.masses[ind3].position[2];
-            }
-            else if (robot.all_cubes[j].masses[k].ID == ind4){
-                robot.all_cubes[j].masses[k].position[0] = robot.masses[ind4].position[0];
-                robot.all_cubes[j].masses[k].position[1] = robot.masses[ind4].position[1];
-                robot.all_cubes[j].masses[k].position[2] = robot.masses[ind4].position[2];
-            }
-            else if (robot.all_cubes[j].masses[k].ID == ind5){
-                robot.all_cubes[j].masses[k].position[0] = robot.masses[ind5].position[0];
-                robot.all_cubes[j].masses[k].position[1] = robot.masses[ind5].position[1];
-                robot.all_cubes[j].masses[k].position[2] = robot.masses[ind5].position[2];
-            }
-            else if (robot.all_cubes[j].masses[k].ID == ind6){
-                robot.all_cubes[j].masses[k].position[0] = robot.masses[ind6].position[0];
-                robot.all_cubes[j].masses[k].position[1] = robot.masses[ind6].position[1];
-                robot.all_cubes[j].masses[k].position[2] = robot.masses[ind6].position[2];
+        source[j] = (int)pending.size();
+        pending_index[hashes[j]] = (int)pending.size();
+        pending.push_back(jobs[j]);
+        pending_job.push_back(j);
+        fitness_cache.misses += 1;
+    }
+    
+    simulate_jobs(pending);
+    
+    for (int p=0; p<pending.size(); p++){
+        if (pending[p].steps_skipped > 0){
+            race_steps_saved += pending[p].steps_skipped; //a stopped run is not its real fitness, so it is never cached
+        }
+        else{
+            cache_insert(keys[pending_job[p]], hashes[pending_job[p]], pending[p].fitness);
+        }
+    }
+    for (int j=0; j<jobs.size(); j++){
+        if (source[j] >= 0){
+            jobs[j].fitness = pending[source[j]].fitness;
+        }
+    }
+}
+
+void simulate_jobs(vector<FitnessJob> &jobs){
+    if (jobs.empty()){
+        return;
+    }
+    unique_lock<mutex> guard(evaluation_pool.lock);
+    evaluation_pool.jobs = &jobs;
+    evaluation_pool.task_first.clear();
+    for (int j=0; j<jobs.size(); j++){
+        //consecutive jobs on the same robot share a task, up to batch_lanes of them
+        int task_start = evaluation_pool.task_first.empty() ? -1 : evaluation_pool.task_first.back();
+        if (!batching || task_start < 0 || jobs[j].robot != jobs[task_start].robot || j-task_start == batch_lanes){
+            evaluation_pool.task_first.push_back(j);
+        }
+    }
+    evaluation_pool.task_first.push_back((int)jobs.size());
+    evaluation_pool.next_task = 0;
+    evaluation_pool.jobs_done = 0;
+    evaluation_pool.wake.notify_all();
+    
+    run_jobs(guard);
+    evaluation_pool.finished.wait(guard, []{ return evaluation_pool.jobs_done == evaluation_pool.jobs->size(); });
+    evaluation_pool.jobs = nullptr;
+}
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t bytes){
+    //FNV-1a
+    const unsigned char *p = (const unsigned char*)data;
+    for (size_t i=0; i<bytes; i++){
+        hash = (hash ^ p[i])*1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t check_bytes(uint64_t hash, const void *data, size_t bytes){
+    //a second, unrelated hash so two different robots never get mistaken for each other
+    const unsigned char *p = (const unsigned char*)data;
+    for (size_t i=0; i<bytes; i++){
+        hash = (hash + p[i] + 1)*0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+void hash_robot(const Robot &robot, FitnessKey &key){
+    //robots are told apart by shape, not genome, so the many genomes that build one shape share their simulations
+    key.robot_hash = robot.body->shape_hash;
+    key.robot_check = robot.body->shape_check;
+}
+
+void hash_shape(RobotBody &body){
+    //the shape is which voxel each cube sits in, counted from cube 0, so it does not depend on where the robot was shifted to;
+    //cubes keep their numbers since cube i is driven by equation i. Genomes naming different parents or clash walks for the
+    //same placements give the same shape; their masses and springs can be numbered differently, which only changes rounding
+    int cubes = (int)body.all_cubes.size();
+    vector<int> voxels(3*cubes);
+    for (int i=0; i<cubes; i++){
+        for (int a=0; a<3; a++){
+            voxels[3*i+a] = (int)lround((body.all_cubes[i].center[a]-body.all_cubes[0].center[a])/0.5f);
+        }
+    }
+    
+    if (turn_shapes){
+        //quarter turns about the vertical through cube 0; the ground is the same in every direction, so keep the smallest
+        vector<int> turned = voxels;
+        for (int r=1; r<4; r++){
+            for (int i=0; i<cubes; i++){
+                int x = turned[3*i];
+                turned[3*i] = -turned[3*i+1];
+                turned[3*i+1] = x;
             }
-            else if (robot.all_cubes[j].masses[k].ID == ind7){
-                robot.all_cubes[j].masses[k].position[0] = robot.masses[ind7].position[0];
-                robot.all_cubes[j].masses[k].position[1] = robot.masses[ind7].position[1];
-                robot.all_cubes[j].masses[k].position[2] = robot.masses[ind7].position[2];
+            if (turned < voxels){
+                voxels = turned;
             }
         }
     }
+    
+    uint64_t h1 = hash_bytes(14695981039346656037ULL, &cubes, sizeof(cubes));
+    uint64_t h2 = check_bytes(0, &cubes, sizeof(cubes));
+    body.shape_hash = hash_bytes(h1, voxels.data(), voxels.size()*sizeof(int));
+    body.shape_check = check_bytes(h2, voxels.data(), voxels.size()*sizeof(int));
+}
+
+uint64_t hash_key(const FitnessKey &key){
+    return hash_bytes(key.robot_hash ^ key.robot_check, key.motor.data(), key.motor.size()*sizeof(Equation));
 }
 
-void reset_forces(Robot &robot){
-    for(int i=0; i<robot.masses.size(); i++){
-        robot.masses[i].forces = {0.0f, 0.0f, 0.0f};
+bool same_key(const FitnessKey &key1, const FitnessKey &key2){
+    if (key1.robot_hash != key2.robot_hash || key1.robot_check != key2.robot_check || key1.motor.size() != key2.motor.size()){
+        return false;
     }
+    for (int i=0; i<key1.motor.size(); i++){
+        const Equation &eqn1 = key1.motor[i];
+        const Equation &eqn2 = key2.motor[i];
+        if (eqn1.k != eqn2.k || eqn1.a != eqn2.a || eqn1.w != eqn2.w || eqn1.c != eqn2.c){
+            return false;
+        }
+    }
+    return true;
 }
 
-void update_forces(Robot &robot){
-    
-    for (int i=0; i<robot.springs.size(); i++){
+bool cache_lookup(const FitnessKey &key, uint64_t hash, float &fitness){
+    auto found = fitness_cache.index.find(hash);
+    if (found == fitness_cache.index.end() || !same_key(found->second->first, key)){
+        return false;
+    }
+    fitness_cache.entries.splice(fitness_cache.entries.begin(), fitness_cache.entries, found->second); //now the most recently used
+    fitness = found->second->second;
+    return true;
+}
 
-        int p0 = robot.springs[i].m0;
-        int p1 = robot.springs[i].m1;
+void cache_insert(const FitnessKey &key, uint64_t hash, float fitness){
+    if (fitness_cache.capacity == 0){
+        return;
+    }
+    auto found = fitness_cache.index.find(hash);
+    if (found != fitness_cache.index.end()){
+        //a different key with the same hash; the newer one replaces it
+        fitness_cache.entries.erase(found->second);
+        fitness_cache.index.erase(found);
+    }
+    while (fitness_cache.entries.size() >= fitness_cache.capacity){
+        fitness_cache.index.erase(hash_key(fitness_cache.entries.back().first));
+        fitness_cache.entries.pop_back();
+    }
+    fitness_cache.entries.push_front(make_pair(key, fitness));
+    fitness_cache.index[hash] = fitness_cache.entries.begin();
+}
+//-----------------------------------------------------------------------
 
-        vector<float> pos0 = robot.masses[p0].position;
-        vector<float> pos1 = robot.masses[p1].position;
+//POSITION, FORCE CALCULATIONS, AND CONTROLLER IMPLEMENTATION OCCUR HERE AND BELOW
+//-----------------------------------------------------------------------
+void compile_actuation_plan(const RobotBody &body, ActuationPlan &plan){
+    //replays the old per-step search once: each cube breathes the springs among its first 28 springIDs, and a spring touched by several cubes keeps the last cube's values
+    const SimTopology &topology = body.topology;
+    int n_springs = (int)body.springs.size();
+    int idle = (int)body.all_cubes.size(); //motor whose wave is always 0 and whose k is spring_constant, for springs no cube breathes
+    vector<int> length_motor(n_springs, idle);
+    vector<int> stiffness_motor(n_springs, -1);
+    vector<float> original_L0(n_springs);
+    
+    for (int s=0; s<n_springs; s++){
+        original_L0[s] = body.springs[s].original_L0;
+    }
+    
+    for (int i=0; i<body.all_cubes.size(); i++){
+        const Cube &cube = body.all_cubes[i];
+        int window = min((int)cube.springIDs.size(), 28);
+        
+        for (int k=0; k<28; k++){
+            for (int j=0; j<window; j++){
+                if (cube.springs[k].ID == cube.springIDs[j]){
+                    length_motor[cube.springIDs[j]] = i;
+                    original_L0[cube.springIDs[j]] = cube.springs[k].original_L0;
+                    break;
+                }
+            }
+        }
+        for (int j=0; j<window; j++){
+            stiffness_motor[cube.springIDs[j]] = i;
+        }
+    }
+    
+    plan.n_motors = (int)body.all_cubes.size();
+    plan.entries.clear();
+    plan.merged.clear();
+    plan.merged_parts.clear();
+    for (int i=0; i<topology.body_spring.size(); i++){
+        int s = topology.body_spring[i];
+        int first = topology.merged_first[i];
+        int last = topology.merged_first[i+1];
+        if (last > first){
+            MergedActuator merged;
+            merged.spring = i;
+            merged.first = (int)plan.merged_parts.size();
+            merged.count = last-first+1;
+            for (int p=first-1; p<last; p++){
+                int part_spring = p < first ? s : topology.merged_springs[p];
+                ActuatorEntry part;
+                part.spring = i;
+                part.original_L0 = original_L0[part_spring];
+                part.length_motor = length_motor[part_spring];
+                part.stiffness_motor = stiffness_motor[part_spring] >= 0 ? stiffness_motor[part_spring] : idle;
+                plan.merged_parts.push_back(part);
+            }
+            plan.merged.push_back(merged);
+        }
+        else if (stiffness_motor[s] >= 0){
+            ActuatorEntry entry;
+            entry.spring = i;
+            entry.original_L0 = original_L0[s];
+            entry.length_motor = length_motor[s];
+            entry.stiffness_motor = stiffness_motor[s];
+            plan.entries.push_back(entry);
+        }
+    }
+}
 
-        float spring_length = sqrt(pow(pos1[0]-pos0[0], 2) + pow(pos1[1]-pos0[1], 2) + pow(pos1[2]-pos0[2], 2));
+void update_breathing(SimState &state, const ActuationPlan &plan, Controller &control, const SimContext &ctx){
+    advance_phases(state.phases, ctx.T);
+    for (int i=0; i<plan.n_motors; i++){
+        state.motor_wave[i] = control.motor[i].a*state.phases.value[state.phases.motor_phase[i]];
+        state.motor_k[i] = control.motor[i].k;
+    }
+    
+    for (int e=0; e<plan.entries.size(); e++){
+        const ActuatorEntry &entry = plan.entries[e];
+        state.L0[entry.spring] = entry.original_L0 + state.motor_wave[entry.length_motor];
+        state.k[entry.spring] = state.motor_k[entry.stiffness_motor];
+    }
+    
+    for (int e=0; e<plan.merged.size(); e++){
+        const MergedActuator &merged = plan.merged[e];
+        float k = 0;
+        float weighted_L0 = 0;
+        for (int p=merged.first; p<merged.first+merged.count; p++){
+            const ActuatorEntry &part = plan.merged_parts[p];
+            float part_k = state.motor_k[part.stiffness_motor];
+            k += part_k;
+            weighted_L0 += part_k*(part.original_L0 + state.motor_wave[part.length_motor]);
+        }
+        state.k[merged.spring] = k;
+        state.L0[merged.spring] = weighted_L0/k;
+    }
+}
 
-        robot.springs[i].L = spring_length;
-        float force = -robot.springs[i].k*(spring_length-robot.springs[i].L0);
+void build_phase_table(PhaseTable &phases, const Controller *const *controls, int lanes, int n_motors){
+    //w and c only come from const_w and const_c (or are both 0), so a run has a handful of pairs however many motors and lanes share them
+    phases.w.clear();
+    phases.c.clear();
+    phases.motor_phase.resize(n_motors*lanes);
+    for (int i=0; i<n_motors; i++){
+        for (int l=0; l<lanes; l++){
+            const Equation &eqn = controls[l]->motor[i];
+            int p = 0;
+            while (p < phases.w.size() && !(phases.w[p] == eqn.w && phases.c[p] == eqn.c)){
+                p++;
+            }
+            if (p == phases.w.size()){
+                phases.w.push_back(eqn.w);
+                phases.c.push_back(eqn.c);
+            }
+            phases.motor_phase[i*lanes+l] = p;
+        }
+    }
+    phases.value.resize(phases.w.size());
+}
 
-        float x_univ = (pos0[0]-pos1[0])/spring_length;
-        float y_univ = (pos0[1]-pos1[1])/spring_length;
-        float z_univ = (pos0[2]-pos1[2])/spring_length;
-        vector<float> force_unit_dir_2_1 = {x_univ,y_univ,z_univ};
-        vector<float> force_unit_dir_1_2 = {-x_univ,-y_univ,-z_univ};
+void advance_phases(PhaseTable &phases, float T){
+    //the same sin(w*T+c) every motor used to take for itself, so the waves are unchanged to the bit
+    for (int p=0; p<phases.w.size(); p++){
+        phases.value[p] = sin(phases.w[p]*T+phases.c[p]);
+    }
+}
 
-        for (int n = 0; n < 3; n++) {
-            robot.masses[p0].forces[n] =  robot.masses[p0].forces[n] + force * force_unit_dir_2_1[n];
-            robot.masses[p1].forces[n] =  robot.masses[p1].forces[n] + force * force_unit_dir_1_2[n];
+void build_sim_template(RobotBody &body){
+    //packs a freshly built body for the simulator: its topology, the state every run starts from, and its actuation plan
+    SimTopology &topology = body.topology;
+    SimState &state = body.initial;
+    state.n_masses = (int)body.masses.size();
+    
+    //neighbour fusion leaves a spring from every cube sharing an edge on the same pair of masses; each edge is simulated once, keyed by (lower, higher) mass
+    unordered_map<uint64_t, int> edges;
+    edges.reserve(body.springs.size());
+    vector<int> edge_of(body.springs.size());
+    topology.body_spring.clear();
+    for (int s=0; s<body.springs.size(); s++){
+        uint64_t lo = (uint64_t)min(body.springs[s].m0, body.springs[s].m1);
+        uint64_t hi = (uint64_t)max(body.springs[s].m0, body.springs[s].m1);
+        auto found = edges.find((lo << 32) | hi);
+        if (found == edges.end()){
+            found = edges.emplace((lo << 32) | hi, (int)topology.body_spring.size()).first;
+            topology.body_spring.push_back(s);
+        }
+        edge_of[s] = found->second;
+    }
+    state.n_springs = (int)topology.body_spring.size();
+    
+    //the rest of each edge's springs, grouped by edge in spring order
+    topology.merged_first.assign(state.n_springs+1, 0);
+    for (int s=0; s<body.springs.size(); s++){
+        if (topology.body_spring[edge_of[s]] != s){
+            topology.merged_first[edge_of[s]+1]++;
         }
     }
+    for (int i=0; i<state.n_springs; i++){
+        topology.merged_first[i+1] += topology.merged_first[i];
+    }
+    topology.merged_springs.resize(topology.merged_first[state.n_springs]);
+    vector<int> next_slot(topology.merged_first.begin(), topology.merged_first.end()-1);
+    for (int s=0; s<body.springs.size(); s++){
+        if (topology.body_spring[edge_of[s]] != s){
+            topology.merged_springs[next_slot[edge_of[s]]++] = s;
+        }
+    }
+    
+    topology.mass.resize(state.n_masses);
+    state.px.resize(state.n_masses);
+    state.py.resize(state.n_masses);
+    state.pz.resize(state.n_masses);
+    state.vx.resize(state.n_masses);
+    state.vy.resize(state.n_masses);
+    state.vz.resize(state.n_masses);
+    state.fx.assign(state.n_masses, 0.0f);
+    state.fy.assign(state.n_masses, 0.0f);
+    state.fz.assign(state.n_masses, 0.0f);
+    
+    for (int i=0; i<state.n_masses; i++){
+        topology.mass[i] = body.masses[i].mass;
+        state.px[i] = body.masses[i].position[0];
+        state.py[i] = body.masses[i].position[1];
+        state.pz[i] = body.masses[i].position[2];
+        state.vx[i] = body.masses[i].velocity[0];
+        state.vy[i] = body.masses[i].velocity[1];
+        state.vz[i] = body.masses[i].velocity[2];
+    }
+    
+    topology.m0.resize(state.n_springs);
+    topology.m1.resize(state.n_springs);
+    state.L0.resize(state.n_springs);
+    state.L.resize(state.n_springs);
+    state.k.resize(state.n_springs);
+    state.sfx.assign(state.n_springs, 0.0f);
+    state.sfy.assign(state.n_springs, 0.0f);
+    state.sfz.assign(state.n_springs, 0.0f);
+    
+    for (int i=0; i<state.n_springs; i++){
+        const Spring &spring = body.springs[topology.body_spring[i]];
+        topology.m0[i] = spring.m0;
+        topology.m1[i] = spring.m1;
+        state.L0[i] = spring.L0;
+        state.L[i] = spring.L;
+        state.k[i] = spring.k;
+        if (topology.merged_first[i+1] > topology.merged_first[i]){
+            float k = spring.k;
+            float weighted_L0 = spring.k*spring.L0;
+            for (int p=topology.merged_first[i]; p<topology.merged_first[i+1]; p++){
+                const Spring &other = body.springs[topology.merged_springs[p]];
+                k += other.k;
+                weighted_L0 += other.k*other.L0;
+            }
+            state.k[i] = k;
+            state.L0[i] = weighted_L0/k;
+        }
+    }
+    
+    topology.mass_single.assign(topology.mass.begin(), topology.mass.end());
+    state.mass = topology.mass.data();
+    state.mass_single = topology.mass_single.data();
+    state.m0 = topology.m0.data();
+    state.m1 = topology.m1.data();
+    
+    //bounds for choose_timestep: every spring at the stiffest k a controller can give it
+    float k_max = max(*max_element(const_k.begin(), const_k.end()), spring_constant);
+    vector<float> load(state.n_masses, 0.0f);
+    for (int i=0; i<state.n_springs; i++){
+        float k = (1 + topology.merged_first[i+1] - topology.merged_first[i])*k_max;
+        load[topology.m0[i]] += k;
+        load[topology.m1[i]] += k;
+    }
+    topology.stiffest = 0;
+    topology.lightest = state.n_masses > 0 ? (float)topology.mass[0] : 1.0f;
+    for (int j=0; j<state.n_masses; j++){
+        topology.stiffest = max(topology.stiffest, (float)(2*load[j]/topology.mass[j]));
+        topology.lightest = min(topology.lightest, (float)topology.mass[j]);
+    }
     
-    for (int j=0; j<robot.masses.size(); j++){
-        robot.masses[j].forces[2] = robot.masses[j].forces[2] + robot.masses[j].mass*g;
+    compile_actuation_plan(body, body.plan);
+    state.motor_wave.assign(body.plan.n_motors+1, 0.0f);
+    state.motor_k.assign(body.plan.n_motors+1, spring_constant);
+}
+
+void copy_floats(const vector<float> &from, vector<float> &to){
+    to.resize(from.size()); //only allocates while the buffer is still growing
+    memcpy(to.data(), from.data(), from.size()*sizeof(float));
+}
+
+void load_sim_state(const SimState &initial, SimState &state){
+    //resets a reusable buffer to a body's starting state; the topology is pointed at, not copied
+    state.n_masses = initial.n_masses;
+    state.n_springs = initial.n_springs;
+    state.mass = initial.mass;
+    state.mass_single = initial.mass_single;
+    state.m0 = initial.m0;
+    state.m1 = initial.m1;
+    copy_floats(initial.px, state.px);
+    copy_floats(initial.py, state.py);
+    copy_floats(initial.pz, state.pz);
+    copy_floats(initial.vx, state.vx);
+    copy_floats(initial.vy, state.vy);
+    copy_floats(initial.vz, state.vz);
+    copy_floats(initial.fx, state.fx);
+    copy_floats(initial.fy, state.fy);
+    copy_floats(initial.fz, state.fz);
+    copy_floats(initial.L0, state.L0);
+    copy_floats(initial.L, state.L);
+    copy_floats(initial.k, state.k);
+    copy_floats(initial.sfx, state.sfx);
+    copy_floats(initial.sfy, state.sfy);
+    copy_floats(initial.sfz, state.sfz);
+    copy_floats(initial.motor_wave, state.motor_wave);
+    copy_floats(initial.motor_k, state.motor_k);
+    state.last_dt = 0;
+    if (integrator == VELOCITY_VERLET){
+        state.ax.resize(state.n_masses);
+        state.ay.resize(state.n_masses);
+        state.az.resize(state.n_masses);
+    }
+}
+
+template<typename Real>
+void update_pos_vel_acc(SimState &state, const SimContext &ctx){
+    float dt = ctx.dt;
+    Real b = ctx.b;
+    const Real *mass = mass_as<Real>(state);
+    
+    for (int i=0; i<state.n_masses; i++){
+        float acc_x = state.fx[i]/mass[i];
+        float acc_y = state.fy[i]/mass[i];
+        float acc_z = state.fz[i]/mass[i];
+        
+        float vel_x = acc_x*dt + state.vx[i];
+        float vel_y = acc_y*dt + state.vy[i];
+        float vel_z = acc_z*dt + state.vz[i];
+        
+        
+        state.vx[i] = vel_x*b;
+        state.vy[i] = vel_y*b;
+        state.vz[i] = vel_z*b;
+        
+        state.px[i] = (vel_x*dt) + state.px[i];
+        state.py[i] = (vel_y*dt) + state.py[i];
+        state.pz[i] = (vel_z*dt) + state.pz[i];
+    }
+}
+
+template<typename Real>
+void update_pos_vel_acc_verlet(SimState &state, const SimContext &ctx){
+    //velocity Verlet: the forces just computed finish last step's velocity, over last step's dt, then move the masses with them
+    float dt = ctx.dt;
+    float last_dt = state.last_dt;
+    Real b = ctx.b;
+    const Real *mass = mass_as<Real>(state);
+    
+    for (int i=0; i<state.n_masses; i++){
+        float acc_x = state.fx[i]/mass[i];
+        float acc_y = state.fy[i]/mass[i];
+        float acc_z = state.fz[i]/mass[i];
         
-        if (robot.masses[j].position[2] < 0){
-            robot.masses[j].forces[2] = -robot.masses[j].position[2]*1000000.0f;
+        if (last_dt > 0){
+            state.vx[i] = (state.vx[i] + 0.5f*(state.ax[i]+acc_x)*last_dt)*b;
+            state.vy[i] = (state.vy[i] + 0.5f*(state.ay[i]+acc_y)*last_dt)*b;
+            state.vz[i] = (state.vz[i] + 0.5f*(state.az[i]+acc_z)*last_dt)*b;
         }
         
-        float F_n = robot.masses[j].mass*g;
+        state.px[i] = state.px[i] + state.vx[i]*dt + 0.5f*acc_x*dt*dt;
+        state.py[i] = state.py[i] + state.vy[i]*dt + 0.5f*acc_y*dt*dt;
+        state.pz[i] = state.pz[i] + state.vz[i]*dt + 0.5f*acc_z*dt*dt;
+        
+        state.ax[i] = acc_x;
+        state.ay[i] = acc_y;
+        state.az[i] = acc_z;
+    }
+    state.last_dt = dt;
+}
 
-        float F_h = sqrt(pow(robot.masses[j].forces[0], 2) + pow(robot.masses[j].forces[1], 2));
+template<typename Real>
+void integrate(SimState &state, const SimContext &ctx){
+    if (integrator == VELOCITY_VERLET){
+        update_pos_vel_acc_verlet<Real>(state, ctx);
+    }
+    else{
+        update_pos_vel_acc<Real>(state, ctx);
+    }
+}
 
+template<typename Real, int Lanes>
+void integrate_batch(BatchState &batch, const SimContext &ctx){
+    if (integrator == VELOCITY_VERLET){
+        update_pos_vel_acc_verlet_batch<Real, Lanes>(batch, ctx);
+    }
+    else{
+        update_pos_vel_acc_batch<Real, Lanes>(batch, ctx);
+    }
+}
 
-        if (F_n < 0){
-            if (F_h < -F_n*mu_s){
-                robot.masses[j].forces[0] = 0;
-                robot.masses[j].forces[1] = 0;
-            }
-            if (F_h >= -F_n*mu_s){
-                if (robot.masses[j].forces[0] > 0){
-                    robot.masses[j].forces[0] = robot.masses[j].forces[0] + mu_k*F_n;
-                }
-                else{
-                    robot.masses[j].forces[0] = robot.masses[j].forces[0] - mu_k*F_n;
-                }
-                if (robot.masses[j].forces[1] > 0){
-                    robot.masses[j].forces[1] = robot.masses[j].forces[1] + mu_k*F_n;
-                }
-                else{
-                    robot.masses[j].forces[1] = robot.masses[j].forces[1] - mu_k*F_n;
-                }
-            }
-        }
+template<typename Real, int Lanes>
+void step_batch(BatchState &batch, const ActuationPlan &plan, vector<const Controller*> &controls, const SimContext &ctx){
+    //one step of every lane; Lanes is the batch width when it is known at compile time, so the lane loops unroll with no remainder, or 0 to read it from the batch
+    if (breathing) {
+        update_breathing_batch<Lanes>(batch, plan, controls, ctx);
     }
+    update_forces_batch<Real, Lanes>(batch, ctx);
+    integrate_batch<Real, Lanes>(batch, ctx);
+    reset_forces_batch(batch);
 }
-// ----------------------------------------------------------------------
 
-//BREEDING ROBOTS OCCURS HERE!!
-// ----------------------------------------------------------------------
-void get_robot_population(vector<Robot> &robot_population){
-    int individuals = 0;
+template<typename Real>
+BatchStep batch_step_as(int lanes){
+    if (lanes == fixed_lanes[0]){
+        return step_batch<Real, fixed_lanes[0]>;
+    }
+    if (lanes == fixed_lanes[1]){
+        return step_batch<Real, fixed_lanes[1]>;
+    }
+    return step_batch<Real, 0>;
+}
+
+BatchStep batch_step(int lanes){
+    //picked whenever a batch is built or loses lanes, never per step
+    return single_precision ? batch_step_as<float>(lanes) : batch_step_as<double>(lanes);
+}
+
+template<typename Real, typename State>
+const Real *mass_as(const State &state){
+    //the masses in the precision a kernel runs at; double is the original mixed precision policy, where float positions and forces meet double masses, g and b
+    if constexpr (is_same<Real, double>::value){
+        return state.mass;
+    }
+    else{
+        return state.mass_single;
+    }
+}
+
+void choose_timestep(SimContext &ctx, const RobotBody &body){
+    //spreads each checkpoint over whole steps no longer than the dt asked for, so checkpoints stay checkpoint_time apart at any dt
+    float dt;
+    if (auto_timestep){
+        //the fastest oscillation is the ground penalty on the lightest mass or the stiffest mass on its springs; explicit steps are stable to dt = 2/omega, but fitness ranking needs far shorter ones
+        dt = period_step(max(ground_stiffness/body.topology.lightest, body.topology.stiffest));
+    }
+    else if (fixed_timestep > 0){
+        dt = fixed_timestep;
+    }
+    else{
+        return; //the original 0.0001, 50 steps a checkpoint
+    }
+    ctx.dt = step_limit(dt, checkpoint_time);
+    ctx.steps_per_run = (int)lround(checkpoint_time/ctx.dt);
+}
+
+float period_step(float omega2){
+    //dt that spends steps_per_period steps on an oscillation of squared angular frequency omega2
+    return 2*M_PI/(steps_per_period*sqrt(omega2));
+}
+
+float step_limit(float dt, float remaining){
+    //splits what is left of a checkpoint into equal steps no longer than dt, so the last one does not end on a sliver
+    int steps = max(1, (int)ceil(remaining/dt - 0.001f));
+    return steps == 1 ? remaining : remaining/steps;
+}
+
+float adaptive_dt(const SimState &state, const SimTopology &topology, float remaining){
+    //long steps set by the springs while every mass is clear of the ground, by the ground penalty once one could reach it,
+    //and never so long that a spring's ends close or open by more than extension_tolerance of an edge
+    float free_dt = period_step(topology.stiffest);
+    float contact_dt = period_step(ground_stiffness/topology.lightest);
+    
+    bool near = false;
+    for (int j=0; j<state.n_masses; j++){
+        near = near || state.pz[j] + min(state.vz[j], 0.0f)*free_dt < contact_height;
+    }
+    float top_speed = 0; //fastest any spring's ends move apart or together, squared
+    for (int i=0; i<state.n_springs; i++){
+        float dvx = state.vx[state.m0[i]]-state.vx[state.m1[i]];
+        float dvy = state.vy[state.m0[i]]-state.vy[state.m1[i]];
+        float dvz = state.vz[state.m0[i]]-state.vz[state.m1[i]];
+        top_speed = max(top_speed, dvx*dvx + dvy*dvy + dvz*dvz);
+    }
     
-    while (individuals < 10) {
-        cout << "New Robot" << endl;
-        Robot robot;
-        initialize_robot(robot);
-        
-        robot_population.push_back(robot);
-        individuals += 1;
+    float dt = near ? min(free_dt, contact_dt) : free_dt;
+    if (top_speed > 0){
+        dt = min(dt, extension_tolerance*edge_length/sqrt(top_speed));
     }
+    return step_limit(max(dt, min_timestep), remaining);
 }
 
-void replenish_robot_population(vector<Robot> &new_robot_set, vector<Controller> &population, vector<Controller> &major_league){
-    int individuals = 0;
+void sync_cube_masses(vector<Cube> &all_cubes, vector<PointMass> &masses){
+    //the cube-local mass copies are only views of the robot's masses, rebuilt here when something needs cube-local positions
+    for (int m=0; m<all_cubes.size(); m++){
+        for (int n=0; n<8; n++){
+            all_cubes[m].masses[n].position = masses[all_cubes[m].masses[n].ID].position;
+        }
+    }
+}
+
+void reset_forces(SimState &state){
+    fill(state.fx.begin(), state.fx.end(), 0.0f);
+    fill(state.fy.begin(), state.fy.end(), 0.0f);
+    fill(state.fz.begin(), state.fz.end(), 0.0f);
+}
+
+#if defined(__AVX2__)
+template<typename Real> __m256 spring_length8(__m256 dx, __m256 dy, __m256 dz);
+
+template<>
+__m256 spring_length8<float>(__m256 dx, __m256 dy, __m256 dz){
+    return _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+}
+
+template<>
+__m256 spring_length8<double>(__m256 dx, __m256 dy, __m256 dz){
+    //squares and sums in double like the scalar path so every kernel produces the same lengths
+    __m256d lo = _mm256_cvtps_pd(_mm256_castps256_ps128(dx));
+    __m256d hi = _mm256_cvtps_pd(_mm256_extractf128_ps(dx, 1));
+    __m256d sum_lo = _mm256_mul_pd(lo, lo);
+    __m256d sum_hi = _mm256_mul_pd(hi, hi);
+    
+    lo = _mm256_cvtps_pd(_mm256_castps256_ps128(dy));
+    hi = _mm256_cvtps_pd(_mm256_extractf128_ps(dy, 1));
+    sum_lo = _mm256_add_pd(sum_lo, _mm256_mul_pd(lo, lo));
+    sum_hi = _mm256_add_pd(sum_hi, _mm256_mul_pd(hi, hi));
+    
+    lo = _mm256_cvtps_pd(_mm256_castps256_ps128(dz));
+    hi = _mm256_cvtps_pd(_mm256_extractf128_ps(dz, 1));
+    sum_lo = _mm256_add_pd(sum_lo, _mm256_mul_pd(lo, lo));
+    sum_hi = _mm256_add_pd(sum_hi, _mm256_mul_pd(hi, hi));
+    
+    __m128 length_lo = _mm256_cvtpd_ps(_mm256_sqrt_pd(sum_lo));
+    __m128 length_hi = _mm256_cvtpd_ps(_mm256_sqrt_pd(sum_hi));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(length_lo), length_hi, 1);
+}
+#elif defined(__SSE2__)
+__m128 spring_length2(__m128 dx, __m128 dy, __m128 dz){
+    //lengths of the two springs in the low lanes, squared and summed in double like the scalar path
+    __m128d x = _mm_cvtps_pd(dx);
+    __m128d y = _mm_cvtps_pd(dy);
+    __m128d z = _mm_cvtps_pd(dz);
+    __m128d sum = _mm_add_pd(_mm_add_pd(_mm_mul_pd(x, x), _mm_mul_pd(y, y)), _mm_mul_pd(z, z));
+    return _mm_cvtpd_ps(_mm_sqrt_pd(sum));
+}
+
+template<typename Real> __m128 spring_length4(__m128 dx, __m128 dy, __m128 dz);
+
+template<>
+__m128 spring_length4<float>(__m128 dx, __m128 dy, __m128 dz){
+    return _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+}
+
+template<>
+__m128 spring_length4<double>(__m128 dx, __m128 dy, __m128 dz){
+    return _mm_movelh_ps(spring_length2(dx, dy, dz), spring_length2(_mm_movehl_ps(dx, dx), _mm_movehl_ps(dy, dy), _mm_movehl_ps(dz, dz)));
+}
+#endif
+
+template<typename Real>
+void update_spring_forces(SimState &state){
+    //computes the Hooke force of every spring 8 (AVX2) or 4 (SSE) springs at a time, then scatters them to the masses in spring order
+    int n = state.n_springs;
+    const float *px = state.px.data();
+    const float *py = state.py.data();
+    const float *pz = state.pz.data();
+    int i = 0;
+    
+#if defined(__AVX2__)
+    for (; i+8<=n; i+=8){
+        __m256i i0 = _mm256_loadu_si256((const __m256i*)&state.m0[i]);
+        __m256i i1 = _mm256_loadu_si256((const __m256i*)&state.m1[i]);
+        
+        __m256 dx = _mm256_sub_ps(_mm256_i32gather_ps(px, i0, 4), _mm256_i32gather_ps(px, i1, 4));
+        __m256 dy = _mm256_sub_ps(_mm256_i32gather_ps(py, i0, 4), _mm256_i32gather_ps(py, i1, 4));
+        __m256 dz = _mm256_sub_ps(_mm256_i32gather_ps(pz, i0, 4), _mm256_i32gather_ps(pz, i1, 4));
+        
+        __m256 length = spring_length8<Real>(dx, dy, dz);
+        __m256 stretch = _mm256_sub_ps(length, _mm256_loadu_ps(&state.L0[i]));
+        __m256 force = _mm256_mul_ps(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&state.k[i])), stretch);
+        
+        _mm256_storeu_ps(&state.L[i], length);
+        _mm256_storeu_ps(&state.sfx[i], _mm256_mul_ps(force, _mm256_div_ps(dx, length)));
+        _mm256_storeu_ps(&state.sfy[i], _mm256_mul_ps(force, _mm256_div_ps(dy, length)));
+        _mm256_storeu_ps(&state.sfz[i], _mm256_mul_ps(force, _mm256_div_ps(dz, length)));
+    }
+#elif defined(__SSE2__)
+    for (; i+4<=n; i+=4){
+        const int *i0 = &state.m0[i];
+        const int *i1 = &state.m1[i];
+        
+        __m128 dx = _mm_sub_ps(_mm_setr_ps(px[i0[0]], px[i0[1]], px[i0[2]], px[i0[3]]), _mm_setr_ps(px[i1[0]], px[i1[1]], px[i1[2]], px[i1[3]]));
+        __m128 dy = _mm_sub_ps(_mm_setr_ps(py[i0[0]], py[i0[1]], py[i0[2]], py[i0[3]]), _mm_setr_ps(py[i1[0]], py[i1[1]], py[i1[2]], py[i1[3]]));
+        __m128 dz = _mm_sub_ps(_mm_setr_ps(pz[i0[0]], pz[i0[1]], pz[i0[2]], pz[i0[3]]), _mm_setr_ps(pz[i1[0]], pz[i1[1]], pz[i1[2]], pz[i1[3]]));
+        
+        __m128 length = spring_length4<Real>(dx, dy, dz);
+        __m128 stretch = _mm_sub_ps(length, _mm_loadu_ps(&state.L0[i]));
+        __m128 force = _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&state.k[i])), stretch);
+        
+        _mm_storeu_ps(&state.L[i], length);
+        _mm_storeu_ps(&state.sfx[i], _mm_mul_ps(force, _mm_div_ps(dx, length)));
+        _mm_storeu_ps(&state.sfy[i], _mm_mul_ps(force, _mm_div_ps(dy, length)));
+        _mm_storeu_ps(&state.sfz[i], _mm_mul_ps(force, _mm_div_ps(dz, length)));
+    }
+#endif
     
-    while (individuals < 5) {
-        cout << "New Robot" << endl;
-        Robot robot;
-        initialize_robot(robot);
+    //scalar fallback, also picks up the remainder of the vector loop
+    for (; i<n; i++){
+        int p0 = state.m0[i];
+        int p1 = state.m1[i];
         
-        float x_center = 0;
-        float y_center = 0;
-        float z_center = 0;
-        for (int m=0; m<robot.masses.size(); m++){
-            x_center += robot.masses[m].position[0];
-            y_center += robot.masses[m].position[1];
-            z_center += robot.masses[m].position[2];
-        }
+        float dx = px[p0]-px[p1];
+        float dy = py[p0]-py[p1];
+        float dz = pz[p0]-pz[p1];
         
-        x_center = x_center/robot.masses.size();
-        y_center = y_center/robot.masses.size();
-        z_center = z_center/robot.masses.size();
+        float spring_length = sqrt((Real)dx*dx + (Real)dy*dy + (Real)dz*dz);
+        float force = -state.k[i]*(spring_length-state.L0[i]);
         
-        robot.center = {x_center, y_center, z_center};
+        state.L[i] = spring_length;
+        state.sfx[i] = force*(dx/spring_length);
+        state.sfy[i] = force*(dy/spring_length);
+        state.sfz[i] = force*(dz/spring_length);
+    }
+    
+    for (int j=0; j<n; j++){
+        int p0 = state.m0[j];
+        int p1 = state.m1[j];
         
-        for (int c=0; c<population.size(); c++){
-            population[c].start = robot.center;
-            float f = determine_fitness(population[c], robot);
-            if (f > robot.fitness){
-                robot.fitness = f;
-                robot.best_controller = population[c];
-            }
-            if (f > population[c].fitness){
-                population[c].fitness = f;
-            }
+        state.fx[p0] += state.sfx[j];
+        state.fy[p0] += state.sfy[j];
+        state.fz[p0] += state.sfz[j];
+        state.fx[p1] -= state.sfx[j];
+        state.fy[p1] -= state.sfy[j];
+        state.fz[p1] -= state.sfz[j];
+    }
+}
+
+template<typename Real>
+void update_forces(SimState &state, const SimContext &ctx){
+    Real g = ctx.g;
+    const Real *mass = mass_as<Real>(state);
+    float mu_s = ctx.mu_s;
+    float mu_k = ctx.mu_k;
+    
+    update_spring_forces<Real>(state);
+    
+    //gravity acts on every mass; the penalty and friction go to the masses under contact_margin, which are gathered first and are all of them unless --contact-friction
+    state.contacts.resize(state.n_masses);
+    int n_contacts = 0;
+    for (int j=0; j<state.n_masses; j++){
+        state.fz[j] = state.fz[j] + mass[j]*g;
+        state.contacts[n_contacts] = j;
+        n_contacts += state.pz[j] < ctx.contact_margin;
+    }
+    
+    for (int c=0; c<n_contacts; c++){
+        int j = state.contacts[c];
+        if (state.pz[j] < 0){
+            state.fz[j] = -state.pz[j]*ground_stiffness;
         }
         
-        if (major_league.size() > 0){
-            for (int m=0; m<major_league.size(); m++){
-                major_league[m].start = robot.center;
-                float f = determine_fitness(major_league[m], robot);
-                if (f > robot.fitness){
-                    robot.fitness = f;
-                    robot.best_controller = major_league[m];
-                }
-                if (f > major_league[m].fitness){
-                    major_league[m].fitness = f;
-                }
-            }
-        }
+        float F_n = mass[j]*g;
+        float F_h = sqrt((Real)state.fx[j]*state.fx[j] + (Real)state.fy[j]*state.fy[j]);
         
-        new_robot_set.push_back(robot);
-        individuals += 1;
+        //static friction holds the mass, kinetic friction opposes each horizontal component; written as selects like the batch kernel
+        bool sticking = F_n < 0 && F_h < -F_n*mu_s;
+        bool sliding = F_n < 0 && F_h >= -F_n*mu_s;
+        float kinetic_x = state.fx[j] > 0 ? state.fx[j] + mu_k*F_n : state.fx[j] - mu_k*F_n;
+        float kinetic_y = state.fy[j] > 0 ? state.fy[j] + mu_k*F_n : state.fy[j] - mu_k*F_n;
+        state.fx[j] = sticking ? 0.0f : (sliding ? kinetic_x : state.fx[j]);
+        state.fy[j] = sticking ? 0.0f : (sliding ? kinetic_y : state.fy[j]);
+    }
+}
+void build_batch_state(const RobotBody &body, int lanes, BatchState &batch){
+    //lanes copies of the body's starting state; the buffers of a thread's earlier batches are reused
+    const SimState &initial = body.initial;
+    batch.lanes = lanes;
+    batch.n_masses = initial.n_masses;
+    batch.n_springs = initial.n_springs;
+    batch.n_motors = body.plan.n_motors;
+    batch.mass = initial.mass;
+    batch.mass_single = initial.mass_single;
+    batch.m0 = initial.m0;
+    batch.m1 = initial.m1;
+    
+    batch.px.resize(batch.n_masses*lanes);
+    batch.py.resize(batch.n_masses*lanes);
+    batch.pz.resize(batch.n_masses*lanes);
+    batch.vx.resize(batch.n_masses*lanes);
+    batch.vy.resize(batch.n_masses*lanes);
+    batch.vz.resize(batch.n_masses*lanes);
+    batch.fx.assign(batch.n_masses*lanes, 0.0f);
+    batch.fy.assign(batch.n_masses*lanes, 0.0f);
+    batch.fz.assign(batch.n_masses*lanes, 0.0f);
+    
+    for (int i=0; i<batch.n_masses; i++){
+        for (int l=0; l<lanes; l++){
+            batch.px[i*lanes+l] = initial.px[i];
+            batch.py[i*lanes+l] = initial.py[i];
+            batch.pz[i*lanes+l] = initial.pz[i];
+            batch.vx[i*lanes+l] = initial.vx[i];
+            batch.vy[i*lanes+l] = initial.vy[i];
+            batch.vz[i*lanes+l] = initial.vz[i];
+        }
+    }
+    
+    batch.L0.resize(batch.n_springs*lanes);
+    batch.k.resize(batch.n_springs*lanes);
+    
+    for (int i=0; i<batch.n_springs; i++){
+        for (int l=0; l<lanes; l++){
+            batch.L0[i*lanes+l] = initial.L0[i];
+            batch.k[i*lanes+l] = initial.k[i];
+        }
+    }
+    
+    batch.motor_wave.assign((batch.n_motors+1)*lanes, 0.0f);
+    batch.motor_k.assign((batch.n_motors+1)*lanes, spring_constant);
+    
+    batch.step = batch_step(lanes);
+    batch.last_dt = 0;
+    if (integrator == VELOCITY_VERLET){
+        batch.ax.resize(batch.n_masses*lanes);
+        batch.ay.resize(batch.n_masses*lanes);
+        batch.az.resize(batch.n_masses*lanes);
     }
 }
 
-void breed_robots(vector<Robot> &new_robot_population, Robot &robot1, Robot &robot2, vector<Controller> &population, vector<Controller> &major_league){
-    Robot offspring;
-    vector<PointMass> masses;
-    vector<Spring> springs;
-    vector<int> cubes;
-    vector<Cube> all_cubes; //initializes all the cubes that will make up this robot
-    vector<int> available_cubes;
+template<int Lanes>
+void update_breathing_batch(BatchState &batch, const ActuationPlan &plan, vector<const Controller*> &controls, const SimContext &ctx){
+    const int lanes = Lanes ? Lanes : batch.lanes;
+    advance_phases(batch.phases, ctx.T);
+    for (int i=0; i<plan.n_motors; i++){
+        for (int l=0; l<lanes; l++){
+            const Equation &eqn = controls[l]->motor[i];
+            batch.motor_wave[i*lanes+l] = eqn.a*batch.phases.value[batch.phases.motor_phase[i*lanes+l]];
+            batch.motor_k[i*lanes+l] = eqn.k;
+        }
+    }
     
-    for (int i=0; i<14; i++){
-        Cube cube;
-        initialize_cube(cube); //initialize the cube
-        if (i<5 || i>9){
-            if (i==0){
-                for (int j=0; j<28; j++){
-                    cube.springs[j].ID = j;
-                    cube.springIDs.push_back(j);
-                    springs.push_back(cube.springs[j]);
-                }
-                for (int k=0; k<8; k++){
-                    cube.masses[k].ID = k;
-                    cube.massIDs.push_back(k);
-                    masses.push_back(cube.masses[k]);
-                }
-                available_cubes.push_back(i);
-            }
-            else{
-                int cube1 = robot1.all_cubes[i].joinedCubes[0];
-                int cube2_face2 = robot1.all_cubes[i].joinedFaces[0];
-                int cube1_face1;
-                
-                vector<int> map1;
-                vector<int> map2;
-                vector<int> masses_left;
-                vector<int> springs_left;
-                
-                for (int s=0; s<8; s++){
-                    masses_left.push_back(s);
-                }
-                
-                for (int v=0; v<28; v++){
-                    springs_left.push_back(v);
-                }
-                
-                if (cube2_face2 == 0){
-                    cube1_face1 = 5;
-                    
-                    map2 = face0;
-                    map1 = face5;
-                }
-                else if (cube2_face2 == 5){
-                    cube1_face1 = 0;
-                    
-                    map2 = face5;
-                    map1 = face0;
-                }
-                else if (cube2_face2 == 1){
-                    cube1_face1 = 3;
-                    
-                    map2 = face1;
-                    map1 = face3;
-                }
-                else if (cube2_face2 == 3){
-                    cube1_face1 = 1;
-                    
-                    map2 = face3;
-                    map1 = face1;
-                }
-                else if (cube2_face2 == 2){
-                    cube1_face1 = 4;
-                    
-                    map2 = face2;
-                    map1 = face4;
-                }
-                else{
-                    cube1_face1 = 2;
-                    
-                    map2 = face4;
-                    map1 = face2;
-                }
-                
-                if (find(all_cubes[cube1].free_faces.begin(), all_cubes[cube1].free_faces.end(), cube1_face1) == all_cubes[cube1].free_faces.end()){
-                    bool clashing = true;
-                    cout << "CLASHING" << endl;
-                    while (clashing) {
-                        int itr6 = find(all_cubes[cube1].joinedFaces.begin(), all_cubes[cube1].joinedFaces.end(), cube1_face1)-all_cubes[cube1].joinedFaces.begin();
-                        cube1 = all_cubes[cube1].joinedCubes[itr6];
-                        if (find(all_cubes[cube1].free_faces.begin(), all_cubes[cube1].free_faces.end(), cube1_face1) != all_cubes[cube1].free_faces.end()){
-                            clashing = false;
-                        }
-                    }
-                    cout << "RESOLVED" << endl;
-                }
-                
-                int itr = find(all_cubes[cube1].free_faces.begin(), all_cubes[cube1].free_faces.end(), cube1_face1)-all_cubes[cube1].free_faces.begin();
-                int itr2 = find(cube.free_faces.begin(), cube.free_faces.end(), cube2_face2)-cube.free_faces.begin();
-                
-                all_cubes[cube1].free_faces.erase(all_cubes[cube1].free_faces.begin()+itr);
-                cube.free_faces.erase(cube.free_faces.begin()+itr2);
-                
-                float cube1_z0 = all_cubes[cube1].masses[0].position[2];
-                
-                if (cube1_face1 == 0 && cube1_z0 == 0){
-                    float x_disp = all_cubes[cube1].masses[map1[0]].position[0]-cube.masses[map2[0]].position[0]; //x displacement
-                    float y_disp = all_cubes[cube1].masses[map1[0]].position[1]-cube.masses[map2[0]].position[1]; //y displacement
-                    float z_disp = all_cubes[cube1].masses[map1[0]].position[2]-cube.masses[map2[0]].position[2]; //z displacement
-                    
-                    for (int m=0; m<all_cubes.size(); m++){
-                        for (int n=0; n<8; n++){
-                            //shift cube 2 over
-                            all_cubes[m].masses[n].position[0] -= x_disp;
-                            all_cubes[m].masses[n].position[1] -= y_disp;
-                            all_cubes[m].masses[n].position[2] -= z_disp;
-                            
-                            masses[all_cubes[m].masses[n].ID].position[0] = all_cubes[m].masses[n].position[0];
-                            masses[all_cubes[m].masses[n].ID].position[1] = all_cubes[m].masses[n].position[1];
-                            masses[all_cubes[m].masses[n].ID].position[2] = all_cubes[m].masses[n].position[2];
-                        }
-                        all_cubes[m].center[0] -= x_disp;
-                        all_cubes[m].center[1] -= y_disp;
-                        all_cubes[m].center[2] -= z_disp;
-                    }
-                }
-                else{
-                    //find where the second cube needs to join the first cube
-                    float x_disp = cube.masses[map2[0]].position[0]-all_cubes[cube1].masses[map1[0]].position[0]; //x displacement
-                    float y_disp = cube.masses[map2[0]].position[1]-all_cubes[cube1].masses[map1[0]].position[1]; //y displacement
-                    float z_disp = cube.masses[map2[0]].position[2]-all_cubes[cube1].masses[map1[0]].position[2]; //z displacement
-                    
-                    for (int u=0; u<8; u++){
-                        //shift cube 2 over
-                        cube.masses[u].position[0] -= x_disp;
-                        cube.masses[u].position[1] -= y_disp;
-                        cube.masses[u].position[2] -= z_disp;
-                    }
-                    
-                    cube.center[0] -= x_disp;
-                    cube.center[1] -= y_disp;
-                    cube.center[2] -= z_disp;
-                }
-                
-                fuse_faces(all_cubes[cube1], cube, cube1, i, masses, springs, cube1_face1, cube2_face2, masses_left, springs_left);
-                
-                for (int q=0; q<all_cubes.size(); q++){
-                    if (all_cubes[q].center[0]-cube.center[0] == 0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[2]-cube.center[2] == 0 && q != cube1){
-                        
-                        int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 2)-all_cubes[q].free_faces.begin();
-                        int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 4)-cube.free_faces.begin();
-                        
-                        all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                        cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                        
-                        fuse_faces(all_cubes[q], cube, q, i, masses, springs, 2, 4, masses_left, springs_left);
-                    }
-                    else if (all_cubes[q].center[0]-cube.center[0] == -0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[2]-cube.center[2] == 0 && q != cube1){
-                        
-                        int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 4)-all_cubes[q].free_faces.begin();
-                        int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 2)-cube.free_faces.begin();
-                        
-                        all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                        cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                        
-                        fuse_faces(all_cubes[q], cube, q, i, masses, springs, 4, 2, masses_left, springs_left);
-                    }
-                    else if (all_cubes[q].center[1]-cube.center[1] == 0.5 && all_cubes[q].center[0]-cube.center[0] == 0 && all_cubes[q].center[2]-cube.center[2] == 0 && q != cube1){
-                        
-                        int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 1)-all_cubes[q].free_faces.begin();
-                        int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 3)-cube.free_faces.begin();
-                        
-                        all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                        cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                        
-                        fuse_faces(all_cubes[q], cube, q, i, masses, springs, 1, 3, masses_left, springs_left);
-                    }
-                    else if (all_cubes[q].center[1]-cube.center[1] == -0.5 && all_cubes[q].center[2]-cube.center[2] == 0 && all_cubes[q].center[0]-cube.center[0] == 0 && q != cube1){
-                        
-                        int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 3)-all_cubes[q].free_faces.begin();
-                        int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 1)-cube.free_faces.begin();
-                        
-                        all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                        cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                        
-                        fuse_faces(all_cubes[q], cube, q, i, masses, springs, 3, 1, masses_left, springs_left);
-                    }
-                    else if (all_cubes[q].center[2]-cube.center[2] == 0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[0]-cube.center[0] == 0 && q != cube1){
-                        
-                        int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 0)-all_cubes[q].free_faces.begin();
-                        int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 5)-cube.free_faces.begin();
-                        
-                        all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                        cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                        
-                        fuse_faces(all_cubes[q], cube, q, i, masses, springs, 0, 5, masses_left, springs_left);
-                    }
-                    else if (all_cubes[q].center[2]-cube.center[2] == -0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[0]-cube.center[0] == 0 && q != cube1){
-                        
-                        int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 5)-all_cubes[q].free_faces.begin();
-                        int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 0)-cube.free_faces.begin();
-                        
-                        all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                        cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                        
-                        fuse_faces(all_cubes[q], cube, q, i, masses, springs, 5, 0, masses_left, springs_left);
-                    }
-                }
-                
-                for (int j=0; j<masses_left.size(); j++){
-                    // if the vertex is not part of face 2 then you can add it to the big vector of masses and make the ID the index of where it is in the big vector of masses
-                    cube.masses[masses_left[j]].ID = masses.size();
-                    cube.massIDs.push_back(masses.size());
-                    masses.push_back(cube.masses[masses_left[j]]);
-                    
-                }
-                
-                for (int k=0; k<springs_left.size(); k++){
-                    int p0 = cube.springs[springs_left[k]].m0;
-                    int p1 = cube.springs[springs_left[k]].m1;
-                    
-                    cube.springs[springs_left[k]].m0 = cube.masses[p0].ID;
-                    cube.springs[springs_left[k]].m1 = cube.masses[p1].ID;
-                    cube.springs[springs_left[k]].ID = springs.size();
-                    cube.springIDs.push_back(springs.size());
-                    springs.push_back(cube.springs[springs_left[k]]);
-                    
-                }
-                
-                if (cube.free_faces.size() < 1){
-                    cout << "Maximized fused faces on this cube" << endl;
-                }
-                else{
-                    available_cubes.push_back(i);
-                }
-                if (all_cubes[cube1].free_faces.size() < 1){
-                    cout << "Maximized fused faces on this cube" << endl;
-                    int itr5 = find(available_cubes.begin(), available_cubes.end(), cube1)-available_cubes.begin();
-                    available_cubes.erase(available_cubes.begin()+itr5);
-                }
-                
-            }
-            
+    for (int e=0; e<plan.entries.size(); e++){
+        const ActuatorEntry &entry = plan.entries[e];
+        float *L0 = &batch.L0[entry.spring*lanes];
+        float *k = &batch.k[entry.spring*lanes];
+        const float *wave = &batch.motor_wave[entry.length_motor*lanes];
+        const float *stiffness = &batch.motor_k[entry.stiffness_motor*lanes];
+        for (int l=0; l<lanes; l++){
+            L0[l] = entry.original_L0 + wave[l];
+            k[l] = stiffness[l];
         }
-        else{
-            int cube1 = robot2.all_cubes[i].joinedCubes[0];
-            int cube2_face2 = robot2.all_cubes[i].joinedFaces[0];
-            int cube1_face1;
-            
-            vector<int> map1;
-            vector<int> map2;
-            vector<int> masses_left;
-            vector<int> springs_left;
-            
-            for (int s=0; s<8; s++){
-                masses_left.push_back(s);
-            }
-            
-            for (int v=0; v<28; v++){
-                springs_left.push_back(v);
-            }
-            
-            if (cube2_face2 == 0){
-                cube1_face1 = 5;
-                
-                map2 = face0;
-                map1 = face5;
-            }
-            else if (cube2_face2 == 5){
-                cube1_face1 = 0;
-                
-                map2 = face5;
-                map1 = face0;
-            }
-            else if (cube2_face2 == 1){
-                cube1_face1 = 3;
-                
-                map2 = face1;
-                map1 = face3;
-            }
-            else if (cube2_face2 == 3){
-                cube1_face1 = 1;
-                
-                map2 = face3;
-                map1 = face1;
-            }
-            else if (cube2_face2 == 2){
-                cube1_face1 = 4;
-                
-                map2 = face2;
-                map1 = face4;
-            }
-            else{
-                cube1_face1 = 2;
-                
-                map2 = face4;
-                map1 = face2;
+    }
+    
+    for (int e=0; e<plan.merged.size(); e++){
+        const MergedActuator &merged = plan.merged[e];
+        float *L0 = &batch.L0[merged.spring*lanes];
+        float *k = &batch.k[merged.spring*lanes];
+        for (int l=0; l<lanes; l++){
+            k[l] = 0;
+            L0[l] = 0; //the k-weighted sum of the parts' L0 until the divide below
+        }
+        for (int p=merged.first; p<merged.first+merged.count; p++){
+            const ActuatorEntry &part = plan.merged_parts[p];
+            const float *wave = &batch.motor_wave[part.length_motor*lanes];
+            const float *stiffness = &batch.motor_k[part.stiffness_motor*lanes];
+            for (int l=0; l<lanes; l++){
+                k[l] += stiffness[l];
+                L0[l] += stiffness[l]*(part.original_L0 + wave[l]);
             }
+        }
+        for (int l=0; l<lanes; l++){
+            L0[l] = L0[l]/k[l];
+        }
+    }
+}
+
+template<typename Real, int Lanes>
+void update_forces_batch(BatchState &batch, const SimContext &ctx){
+    Real g = ctx.g;
+    const Real *mass = mass_as<Real>(batch);
+    float mu_s = ctx.mu_s;
+    float mu_k = ctx.mu_k;
+    const int lanes = Lanes ? Lanes : batch.lanes;
+    
+    for (int i=0; i<batch.n_springs; i++){
+        //both endpoint rows are contiguous over lanes, so each spring is one set of plain vector loads across the robots
+        int p0 = batch.m0[i]*lanes;
+        int p1 = batch.m1[i]*lanes;
+        const float *__restrict x0 = &batch.px[p0];
+        const float *__restrict y0 = &batch.py[p0];
+        const float *__restrict z0 = &batch.pz[p0];
+        const float *__restrict x1 = &batch.px[p1];
+        const float *__restrict y1 = &batch.py[p1];
+        const float *__restrict z1 = &batch.pz[p1];
+        float *__restrict fx0 = &batch.fx[p0];
+        float *__restrict fy0 = &batch.fy[p0];
+        float *__restrict fz0 = &batch.fz[p0];
+        float *__restrict fx1 = &batch.fx[p1];
+        float *__restrict fy1 = &batch.fy[p1];
+        float *__restrict fz1 = &batch.fz[p1];
+        const float *__restrict L0 = &batch.L0[i*lanes];
+        const float *__restrict k = &batch.k[i*lanes];
+        int l = 0;
+        
+#if defined(__AVX2__)
+        for (; l+8<=lanes; l+=8){
+            __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&x0[l]), _mm256_loadu_ps(&x1[l]));
+            __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&y0[l]), _mm256_loadu_ps(&y1[l]));
+            __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(&z0[l]), _mm256_loadu_ps(&z1[l]));
             
-            if (find(all_cubes[cube1].free_faces.begin(), all_cubes[cube1].free_faces.end(), cube1_face1) == all_cubes[cube1].free_faces.end()){
-                bool clashing = true;
-                cout << "CLASHING" << endl;
-                while (clashing) {
-                    int itr6 = find(all_cubes[cube1].joinedFaces.begin(), all_cubes[cube1].joinedFaces.end(), cube1_face1)-all_cubes[cube1].joinedFaces.begin();
-                    cube1 = all_cubes[cube1].joinedCubes[itr6];
-                    if (find(all_cubes[cube1].free_faces.begin(), all_cubes[cube1].free_faces.end(), cube1_face1) != all_cubes[cube1].free_faces.end()){
-                        clashing = false;
-                    }
-                }
-                cout << "RESOLVED" << endl;
-            }
+            __m256 length = spring_length8<Real>(dx, dy, dz);
+            __m256 stretch = _mm256_sub_ps(length, _mm256_loadu_ps(&L0[l]));
+            __m256 force = _mm256_mul_ps(_mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&k[l])), stretch);
             
-            int itr = find(all_cubes[cube1].free_faces.begin(), all_cubes[cube1].free_faces.end(), cube1_face1)-all_cubes[cube1].free_faces.begin();
-            int itr2 = find(cube.free_faces.begin(), cube.free_faces.end(), cube2_face2)-cube.free_faces.begin();
+            __m256 spring_fx = _mm256_mul_ps(force, _mm256_div_ps(dx, length));
+            __m256 spring_fy = _mm256_mul_ps(force, _mm256_div_ps(dy, length));
+            __m256 spring_fz = _mm256_mul_ps(force, _mm256_div_ps(dz, length));
             
-            all_cubes[cube1].free_faces.erase(all_cubes[cube1].free_faces.begin()+itr);
-            cube.free_faces.erase(cube.free_faces.begin()+itr2);
+            _mm256_storeu_ps(&fx0[l], _mm256_add_ps(_mm256_loadu_ps(&fx0[l]), spring_fx));
+            _mm256_storeu_ps(&fy0[l], _mm256_add_ps(_mm256_loadu_ps(&fy0[l]), spring_fy));
+            _mm256_storeu_ps(&fz0[l], _mm256_add_ps(_mm256_loadu_ps(&fz0[l]), spring_fz));
+            _mm256_storeu_ps(&fx1[l], _mm256_sub_ps(_mm256_loadu_ps(&fx1[l]), spring_fx));
+            _mm256_storeu_ps(&fy1[l], _mm256_sub_ps(_mm256_loadu_ps(&fy1[l]), spring_fy));
+            _mm256_storeu_ps(&fz1[l], _mm256_sub_ps(_mm256_loadu_ps(&fz1[l]), spring_fz));
+        }
+#elif defined(__SSE2__)
+        for (; l+4<=lanes; l+=4){
+            __m128 dx = _mm_sub_ps(_mm_loadu_ps(&x0[l]), _mm_loadu_ps(&x1[l]));
+            __m128 dy = _mm_sub_ps(_mm_loadu_ps(&y0[l]), _mm_loadu_ps(&y1[l]));
+            __m128 dz = _mm_sub_ps(_mm_loadu_ps(&z0[l]), _mm_loadu_ps(&z1[l]));
             
-            float cube1_z0 = all_cubes[cube1].masses[0].position[2];
+            __m128 length = spring_length4<Real>(dx, dy, dz);
+            __m128 stretch = _mm_sub_ps(length, _mm_loadu_ps(&L0[l]));
+            __m128 force = _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&k[l])), stretch);
             
-            if (cube1_face1 == 0 && cube1_z0 == 0){
-                float x_disp = all_cubes[cube1].masses[map1[0]].position[0]-cube.masses[map2[0]].position[0]; //x displacement
-                float y_disp = all_cubes[cube1].masses[map1[0]].position[1]-cube.masses[map2[0]].position[1]; //y displacement
-                float z_disp = all_cubes[cube1].masses[map1[0]].position[2]-cube.masses[map2[0]].position[2]; //z displacement
-                
-                for (int m=0; m<all_cubes.size(); m++){
-                    for (int n=0; n<8; n++){
-                        //shift cube 2 over
-                        all_cubes[m].masses[n].position[0] -= x_disp;
-                        all_cubes[m].masses[n].position[1] -= y_disp;
-                        all_cubes[m].masses[n].position[2] -= z_disp;
-                        
-                        masses[all_cubes[m].masses[n].ID].position[0] = all_cubes[m].masses[n].position[0];
-                        masses[all_cubes[m].masses[n].ID].position[1] = all_cubes[m].masses[n].position[1];
-                        masses[all_cubes[m].masses[n].ID].position[2] = all_cubes[m].masses[n].position[2];
-                    }
-                    all_cubes[m].center[0] -= x_disp;
-                    all_cubes[m].center[1] -= y_disp;
-                    all_cubes[m].center[2] -= z_disp;
-                }
-            }
-            else{
-                //find where the second cube needs to join the first cube
-                float x_disp = cube.masses[map2[0]].position[0]-all_cubes[cube1].masses[map1[0]].position[0]; //x displacement
-                float y_disp = cube.masses[map2[0]].position[1]-all_cubes[cube1].masses[map1[0]].position[1]; //y displacement
-                float z_disp = cube.masses[map2[0]].position[2]-all_cubes[cube1].masses[map1[0]].position[2]; //z displacement
-                
-                for (int u=0; u<8; u++){
-                    //shift cube 2 over
-                    cube.masses[u].position[0] -= x_disp;
-                    cube.masses[u].position[1] -= y_disp;
-                    cube.masses[u].position[2] -= z_disp;
-                }
-                
-                cube.center[0] -= x_disp;
-                cube.center[1] -= y_disp;
-                cube.center[2] -= z_disp;
-            }
+            __m128 spring_fx = _mm_mul_ps(force, _mm_div_ps(dx, length));
+            __m128 spring_fy = _mm_mul_ps(force, _mm_div_ps(dy, length));
+            __m128 spring_fz = _mm_mul_ps(force, _mm_div_ps(dz, length));
             
-            fuse_faces(all_cubes[cube1], cube, cube1, i, masses, springs, cube1_face1, cube2_face2, masses_left, springs_left);
+            _mm_storeu_ps(&fx0[l], _mm_add_ps(_mm_loadu_ps(&fx0[l]), spring_fx));
+            _mm_storeu_ps(&fy0[l], _mm_add_ps(_mm_loadu_ps(&fy0[l]), spring_fy));
+            _mm_storeu_ps(&fz0[l], _mm_add_ps(_mm_loadu_ps(&fz0[l]), spring_fz));
+            _mm_storeu_ps(&fx1[l], _mm_sub_ps(_mm_loadu_ps(&fx1[l]), spring_fx));
+            _mm_storeu_ps(&fy1[l], _mm_sub_ps(_mm_loadu_ps(&fy1[l]), spring_fy));
+            _mm_storeu_ps(&fz1[l], _mm_sub_ps(_mm_loadu_ps(&fz1[l]), spring_fz));
+        }
+#endif
+        
+        //scalar fallback for the lanes left over
+        for (; l<lanes; l++){
+            float dx = x0[l]-x1[l];
+            float dy = y0[l]-y1[l];
+            float dz = z0[l]-z1[l];
             
-            for (int q=0; q<all_cubes.size(); q++){
-                if (all_cubes[q].center[0]-cube.center[0] == 0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[2]-cube.center[2] == 0 && q != cube1){
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 2)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 4)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 2, 4, masses_left, springs_left);
-                }
-                else if (all_cubes[q].center[0]-cube.center[0] == -0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[2]-cube.center[2] == 0 && q != cube1){
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 4)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 2)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 4, 2, masses_left, springs_left);
-                }
-                else if (all_cubes[q].center[1]-cube.center[1] == 0.5 && all_cubes[q].center[0]-cube.center[0] == 0 && all_cubes[q].center[2]-cube.center[2] == 0 && q != cube1){
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 1)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 3)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 1, 3, masses_left, springs_left);
-                }
-                else if (all_cubes[q].center[1]-cube.center[1] == -0.5 && all_cubes[q].center[2]-cube.center[2] == 0 && all_cubes[q].center[0]-cube.center[0] == 0 && q != cube1){
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 3)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 1)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 3, 1, masses_left, springs_left);
-                }
-                else if (all_cubes[q].center[2]-cube.center[2] == 0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[0]-cube.center[0] == 0 && q != cube1){
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 0)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 5)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 0, 5, masses_left, springs_left);
-                }
-                else if (all_cubes[q].center[2]-cube.center[2] == -0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[0]-cube.center[0] == 0 && q != cube1){
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 5)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 0)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 5, 0, masses_left, springs_left);
-                }
-            }
+            float spring_length = sqrt((Real)dx*dx + (Real)dy*dy + (Real)dz*dz);
+            float force = -k[l]*(spring_length-L0[l]);
             
+            float spring_fx = force*(dx/spring_length);
+            float spring_fy = force*(dy/spring_length);
+            float spring_fz = force*(dz/spring_length);
             
-            for (int j=0; j<masses_left.size(); j++){
-                // if the vertex is not part of face 2 then you can add it to the big vector of masses and make the ID the index of where it is in the big vector of masses
-                cube.masses[masses_left[j]].ID = masses.size();
-                cube.massIDs.push_back(masses.size());
-                masses.push_back(cube.masses[masses_left[j]]);
-                
-            }
+            fx0[l] += spring_fx;
+            fy0[l] += spring_fy;
+            fz0[l] += spring_fz;
+            fx1[l] -= spring_fx;
+            fy1[l] -= spring_fy;
+            fz1[l] -= spring_fz;
+        }
+    }
+    
+    //gravity for every mass; a mass gets the contact pass only if it is under contact_margin in some lane
+    batch.contacts.resize(batch.n_masses);
+    int n_contacts = 0;
+    for (int j=0; j<batch.n_masses; j++){
+        Real weight = mass[j]*g;
+        float *__restrict fz = &batch.fz[j*lanes];
+        const float *__restrict pz = &batch.pz[j*lanes];
+        bool near = false;
+        for (int l=0; l<lanes; l++){
+            fz[l] = fz[l] + weight;
+            near = near | (pz[l] < ctx.contact_margin);
+        }
+        batch.contacts[n_contacts] = j;
+        n_contacts += near;
+    }
+    
+    for (int c=0; c<n_contacts; c++){
+        int j = batch.contacts[c];
+        float F_n = mass[j]*g;
+        bool friction = F_n < 0;
+        float *__restrict fx = &batch.fx[j*lanes];
+        float *__restrict fy = &batch.fy[j*lanes];
+        float *__restrict fz = &batch.fz[j*lanes];
+        const float *__restrict pz = &batch.pz[j*lanes];
+        
+        for (int l=0; l<lanes; l++){
+            //the rules from update_forces written as selects so the lane loop vectorizes; lanes off the ground keep their forces
+            fz[l] = pz[l] < 0 ? -pz[l]*ground_stiffness : fz[l];
             
-            for (int k=0; k<springs_left.size(); k++){
-                int p0 = cube.springs[springs_left[k]].m0;
-                int p1 = cube.springs[springs_left[k]].m1;
-                
-                cube.springs[springs_left[k]].m0 = cube.masses[p0].ID;
-                cube.springs[springs_left[k]].m1 = cube.masses[p1].ID;
-                cube.springs[springs_left[k]].ID = springs.size();
-                cube.springIDs.push_back(springs.size());
-                springs.push_back(cube.springs[springs_left[k]]);
-                
-            }
+            bool touching = pz[l] < ctx.contact_margin;
+            float F_h = sqrt((Real)fx[l]*fx[l] + (Real)fy[l]*fy[l]);
+            bool sticking = touching && friction && F_h < -F_n*mu_s;
+            bool sliding = touching && friction && F_h >= -F_n*mu_s;
+            float kinetic_x = fx[l] > 0 ? fx[l] + mu_k*F_n : fx[l] - mu_k*F_n;
+            float kinetic_y = fy[l] > 0 ? fy[l] + mu_k*F_n : fy[l] - mu_k*F_n;
+            fx[l] = sticking ? 0.0f : (sliding ? kinetic_x : fx[l]);
+            fy[l] = sticking ? 0.0f : (sliding ? kinetic_y : fy[l]);
+        }
+    }
+}
+
+template<typename Real, int Lanes>
+void update_pos_vel_acc_batch(BatchState &batch, const SimContext &ctx){
+    float dt = ctx.dt;
+    Real b = ctx.b;
+    const int lanes = Lanes ? Lanes : batch.lanes;
+    
+    for (int j=0; j<batch.n_masses; j++){
+        Real mass = mass_as<Real>(batch)[j];
+        float *__restrict fx = &batch.fx[j*lanes];
+        float *__restrict fy = &batch.fy[j*lanes];
+        float *__restrict fz = &batch.fz[j*lanes];
+        float *__restrict vx = &batch.vx[j*lanes];
+        float *__restrict vy = &batch.vy[j*lanes];
+        float *__restrict vz = &batch.vz[j*lanes];
+        float *__restrict px = &batch.px[j*lanes];
+        float *__restrict py = &batch.py[j*lanes];
+        float *__restrict pz = &batch.pz[j*lanes];
+        
+        for (int l=0; l<lanes; l++){
+            float acc_x = fx[l]/mass;
+            float acc_y = fy[l]/mass;
+            float acc_z = fz[l]/mass;
             
-            if (cube.free_faces.size() < 1){
-                cout << "Maximized fused faces on this cube" << endl;
+            float vel_x = acc_x*dt + vx[l];
+            float vel_y = acc_y*dt + vy[l];
+            float vel_z = acc_z*dt + vz[l];
+            
+            vx[l] = vel_x*b;
+            vy[l] = vel_y*b;
+            vz[l] = vel_z*b;
+            
+            px[l] = (vel_x*dt) + px[l];
+            py[l] = (vel_y*dt) + py[l];
+            pz[l] = (vel_z*dt) + pz[l];
+        }
+    }
+}
+
+template<typename Real, int Lanes>
+void update_pos_vel_acc_verlet_batch(BatchState &batch, const SimContext &ctx){
+    //update_pos_vel_acc_verlet across the lanes
+    float dt = ctx.dt;
+    Real b = ctx.b;
+    const int lanes = Lanes ? Lanes : batch.lanes;
+    float last_dt = batch.last_dt;
+    
+    for (int j=0; j<batch.n_masses; j++){
+        Real mass = mass_as<Real>(batch)[j];
+        float *__restrict fx = &batch.fx[j*lanes];
+        float *__restrict fy = &batch.fy[j*lanes];
+        float *__restrict fz = &batch.fz[j*lanes];
+        float *__restrict vx = &batch.vx[j*lanes];
+        float *__restrict vy = &batch.vy[j*lanes];
+        float *__restrict vz = &batch.vz[j*lanes];
+        float *__restrict px = &batch.px[j*lanes];
+        float *__restrict py = &batch.py[j*lanes];
+        float *__restrict pz = &batch.pz[j*lanes];
+        float *__restrict ax = &batch.ax[j*lanes];
+        float *__restrict ay = &batch.ay[j*lanes];
+        float *__restrict az = &batch.az[j*lanes];
+        
+        for (int l=0; l<lanes; l++){
+            float acc_x = fx[l]/mass;
+            float acc_y = fy[l]/mass;
+            float acc_z = fz[l]/mass;
+            
+            if (last_dt > 0){
+                vx[l] = (vx[l] + 0.5f*(ax[l]+acc_x)*last_dt)*b;
+                vy[l] = (vy[l] + 0.5f*(ay[l]+acc_y)*last_dt)*b;
+                vz[l] = (vz[l] + 0.5f*(az[l]+acc_z)*last_dt)*b;
             }
-            else{
-                available_cubes.push_back(i);
+            
+            px[l] = px[l] + vx[l]*dt + 0.5f*acc_x*dt*dt;
+            py[l] = py[l] + vy[l]*dt + 0.5f*acc_y*dt*dt;
+            pz[l] = pz[l] + vz[l]*dt + 0.5f*acc_z*dt*dt;
+            
+            ax[l] = acc_x;
+            ay[l] = acc_y;
+            az[l] = acc_z;
+        }
+    }
+    batch.last_dt = dt;
+}
+
+void compact_batch(BatchState &batch, const vector<int> &keep){
+    //keeps only the lanes listed in keep, in that order
+    int lanes = batch.lanes;
+    int kept = (int)keep.size();
+    vector<float>* per_mass[12] = {&batch.px, &batch.py, &batch.pz, &batch.vx, &batch.vy, &batch.vz, &batch.fx, &batch.fy, &batch.fz, &batch.ax, &batch.ay, &batch.az};
+    vector<float>* per_spring[2] = {&batch.L0, &batch.k};
+    int n_per_mass = integrator == VELOCITY_VERLET ? 12 : 9; //the accelerations are only kept for Verlet
+    
+    for (int a=0; a<n_per_mass; a++){
+        vector<float> &values = *per_mass[a];
+        for (int m=0; m<batch.n_masses; m++){
+            for (int l=0; l<kept; l++){
+                values[m*kept+l] = values[m*lanes+keep[l]]; //keep is increasing, so this never overwrites a value still to be read
             }
-            if (all_cubes[cube1].free_faces.size() < 1){
-                cout << "Maximized fused faces on this cube" << endl;
-                int itr5 = find(available_cubes.begin(), available_cubes.end(), cube1)-available_cubes.begin();
-                available_cubes.erase(available_cubes.begin()+itr5);
+        }
+        values.resize(batch.n_masses*kept);
+    }
+    for (int a=0; a<2; a++){
+        vector<float> &values = *per_spring[a];
+        for (int s=0; s<batch.n_springs; s++){
+            for (int l=0; l<kept; l++){
+                values[s*kept+l] = values[s*lanes+keep[l]];
             }
-            
         }
-        
-        cubes.push_back(i);
-        all_cubes.push_back(cube);
+        values.resize(batch.n_springs*kept);
     }
     
-    offspring.masses = masses;
-    offspring.springs = springs;
-    offspring.all_cubes = all_cubes;
-    offspring.available_cubes = available_cubes;
+    //refilled every step, only the idle motor's values matter
+    batch.motor_wave.assign((batch.n_motors+1)*kept, 0.0f);
+    batch.motor_k.assign((batch.n_motors+1)*kept, spring_constant);
+    batch.lanes = kept;
+    batch.step = batch_step(kept);
+}
+
+void reset_forces_batch(BatchState &batch){
+    fill(batch.fx.begin(), batch.fx.end(), 0.0f);
+    fill(batch.fy.begin(), batch.fy.end(), 0.0f);
+    fill(batch.fz.begin(), batch.fz.end(), 0.0f);
+}
+// ----------------------------------------------------------------------
+
+//BREEDING ROBOTS OCCURS HERE!!
+// ----------------------------------------------------------------------
+void get_robot_population(vector<Robot> &robot_population, Rng &rng){
+    int individuals = 0;
     
-    float x_center = 0;
-    float y_center = 0;
-    float z_center = 0;
-    for (int m=0; m<offspring.masses.size(); m++){
-        x_center += offspring.masses[m].position[0];
-        y_center += offspring.masses[m].position[1];
-        z_center += offspring.masses[m].position[2];
+    while (individuals < 10) {
+        cout << "New Robot" << endl;
+        Robot robot;
+        initialize_robot(robot, rng);
+        
+        robot_population.push_back(robot);
+        individuals += 1;
     }
+}
+
+void replenish_robot_population(vector<Robot> &new_robot_set, vector<Controller> &population, vector<Controller> &major_league, Rng &rng){
+    int individuals = 0;
     
-    x_center = x_center/offspring.masses.size();
-    y_center = y_center/offspring.masses.size();
-    z_center = z_center/offspring.masses.size();
-    
-    offspring.center = {x_center, y_center, z_center};
-    
-    for (int c=0; c<population.size(); c++){
-        population[c].start = offspring.center;
-        float f = determine_fitness(population[c], offspring);
-        if (f > offspring.fitness){
-            offspring.fitness = f;
-            offspring.best_controller = population[c];
-        }
-        if (f > population[c].fitness){
-            population[c].fitness = f;
-        }
+    while (individuals < 5) {
+        cout << "New Robot" << endl;
+        Robot robot;
+        initialize_robot(robot, rng);
+        
+        new_robot_set.push_back(robot);
+        individuals += 1;
     }
     
-    if (major_league.size() > 0){
-        for (int m=0; m<major_league.size(); m++){
-            major_league[m].start = offspring.center;
-            float f = determine_fitness(major_league[m], offspring);
-            if (f > offspring.fitness){
-                offspring.fitness = f;
-                offspring.best_controller = major_league[m];
-            }
-            if (f > major_league[m].fitness){
-                major_league[m].fitness = f;
-            }
+    evaluate_robots(new_robot_set, population, major_league, {});
+}
+
+Robot breed_robots(Robot &robot1, Robot &robot2){
+    //two point crossover of the placement lists; the body is decoded when the offspring is first evaluated
+    Robot offspring;
+    offspring.genome.resize(robot_cubes-1);
+    for (int i=1; i<robot_cubes; i++){
+        if (i<cut_point1 || i>=cut_point2){
+            offspring.genome[i-1] = robot1.genome[i-1];
+        }
+        else{
+            offspring.genome[i-1] = robot2.genome[i-1];
         }
     }
     
-    if (offspring.fitness > robot1.fitness){
-        new_robot_population.push_back(offspring);
-    }
-    else{
-        new_robot_population.push_back(robot1);
-    }
+    return offspring;
 }
 //-----------------------------------------------------------------------
 
 //ROBOT AND CUBE INITIALIZATION HAPPENS HERE AND BELOW
 //-----------------------------------------------------------------------
-void initialize_robot(Robot &robot){
-    vector<PointMass> masses; //initializes the vector of masses that make up the robot
-    vector<Spring> springs; //initializes the vector of springs that make up the robot
-    vector<int> cubes;
-    vector<Cube> all_cubes; //initializes all the cubes that will make up this robot
-    vector<int> available_cubes;
-    for (int i=0; i<14; i++){
+void initialize_robot(Robot &robot, Rng &rng){
+    shared_ptr<RobotBody> body = make_shared<RobotBody>();
+    build_body(robot.genome, *body, &rng);
+    robot.body = body;
+    robot.center = robot_center(robot);
+}
+
+const RobotBody &robot_body(Robot &robot){
+    //decodes the genome on first use; call it from the main thread before the robot is shared with the evaluation workers
+    if (!robot.body){
+        shared_ptr<RobotBody> body = make_shared<RobotBody>();
+        build_body(robot.genome, *body, nullptr);
+        robot.body = body;
+        robot.center = robot_center(robot);
+    }
+    return *robot.body;
+}
+
+void build_body(vector<Placement> &genome, RobotBody &body, Rng *rng){
+    //places the cubes in order; with rng every placement is drawn at random, otherwise genome is followed
+    //either way genome ends up holding the placements actually made, so decoding it again gives the same body
+    vector<PointMass> &masses = body.masses; //the vector of masses that make up the robot
+    vector<Spring> &springs = body.springs; //the vector of springs that make up the robot
+    vector<Cube> &all_cubes = body.all_cubes; //all the cubes that make up this robot
+    CubePool &available_cubes = body.available_cubes;
+    thread_local BuildScratch scratch;
+    CubeAssembly &assembly = scratch.assembly;
+    scratch.grid.cells.clear();
+    bool verbose = rng != nullptr;
+    masses.reserve(robot_cubes*8); //upper bounds, fused faces share masses and springs
+    springs.reserve(robot_cubes*28);
+    all_cubes.reserve(robot_cubes);
+    available_cubes.slot.assign(robot_cubes, -1);
+    assembly.mass_cube.assign(robot_cubes*8, -1);
+    assembly.spring_cube.assign(robot_cubes*28, -1);
+    genome.resize(robot_cubes-1);
+    
+    for (int i=0; i<robot_cubes; i++){
         Cube cube; //define a cube
         initialize_cube(cube); //initialize the cube
         if (i==0){
@@ -1495,96 +2567,72 @@ void initialize_robot(Robot &robot){
                 cube.massIDs.push_back(k);
                 masses.push_back(cube.masses[k]);
             }
-            available_cubes.push_back(i);
+            pool_add(available_cubes, i);
+            grid_add(scratch.grid, voxel_key(0, 0, 0), i);
         }
         else{
-            int cube1 = rand() % available_cubes.size();
-            cube1 = available_cubes[cube1];
-            int face_1 = rand() % all_cubes[cube1].free_faces.size();
-            int cube1_face1 = all_cubes[cube1].free_faces[face_1];
-//            int cube1_face1 = 5;
+            int cube1;
+            int cube1_face1;
             int face_2;
-            vector<int> map1;
-            vector<int> map2;
-            vector<int> masses_left;
-            vector<int> springs_left;
-            
-            for (int s=0; s<8; s++){
-                masses_left.push_back(s);
-            }
-            
-            for (int v=0; v<28; v++){
-                springs_left.push_back(v);
-            }
-            
-            if (cube1_face1 == 0){
-                face_2 = 5;
-                
-                map1 = face0;
-                map2 = face5;
-            }
-            else if (cube1_face1 == 5){
-                face_2 = 0;
-                
-                map1 = face5;
-                map2 = face0;
-            }
-            else if (cube1_face1 == 1){
-                face_2 = 3;
-                
-                map1 = face1;
-                map2 = face3;
-            }
-            else if (cube1_face1 == 3){
-                face_2 = 1;
-                
-                map1 = face3;
-                map2 = face1;
-            }
-            else if (cube1_face1 == 2){
-                face_2 = 4;
-                
-                map1 = face2;
-                map2 = face4;
+            if (rng != nullptr){
+                cube1 = random_int(*rng, (int)available_cubes.cubes.size());
+                cube1 = available_cubes.cubes[cube1];
+                int face_1 = random_int(*rng, __builtin_popcount(all_cubes[cube1].free_faces));
+                cube1_face1 = nth_set_bit(all_cubes[cube1].free_faces, face_1);
+                face_2 = opposite_face[cube1_face1];
             }
             else{
-                face_2 = 2;
+                cube1 = genome[i-1].parent;
+                face_2 = genome[i-1].face;
+                cube1_face1 = opposite_face[face_2];
                 
-                map1 = face4;
-                map2 = face2;
+                if (!(all_cubes[cube1].free_faces >> cube1_face1 & 1)){
+                    //after a crossover the parent's face can already be taken, so walk out along that face to the first cube where it is free
+                    bool clashing = true;
+                    cout << "CLASHING" << endl;
+                    while (clashing) {
+                        int itr6 = find(all_cubes[cube1].joinedFaces.begin(), all_cubes[cube1].joinedFaces.end(), cube1_face1)-all_cubes[cube1].joinedFaces.begin();
+                        cube1 = all_cubes[cube1].joinedCubes[itr6];
+                        if (all_cubes[cube1].free_faces >> cube1_face1 & 1){
+                            clashing = false;
+                        }
+                    }
+                    cout << "RESOLVED" << endl;
+                }
             }
+            genome[i-1].parent = cube1;
+            genome[i-1].face = face_2;
             
-            int itr = find(all_cubes[cube1].free_faces.begin(), all_cubes[cube1].free_faces.end(), cube1_face1)-all_cubes[cube1].free_faces.begin();
-            int itr2 = find(cube.free_faces.begin(), cube.free_faces.end(), face_2)-cube.free_faces.begin();
+            const array<int, 4> &map1 = face_vertices[cube1_face1];
+            const array<int, 4> &map2 = face_vertices[face_2];
+            assembly.masses_left = (1u << 8)-1;
+            assembly.springs_left = (1u << 28)-1;
             
-            all_cubes[cube1].free_faces.erase(all_cubes[cube1].free_faces.begin()+itr);
-            cube.free_faces.erase(cube.free_faces.begin()+itr2);
-//            remove(all_cubes[cube1].free_faces.begin(), all_cubes[cube1].free_faces.end(), all_cubes[cube1].free_faces[face_1]);
-//            remove(cube.free_faces.begin(), cube.free_faces.end(), cube.free_faces[face_2]);
+            all_cubes[cube1].free_faces &= ~(1u << cube1_face1);
+            cube.free_faces &= ~(1u << face_2);
             
             float cube1_z0 = all_cubes[cube1].masses[0].position[2];
             
             if (cube1_face1 == 0 && cube1_z0 == 0){
-                cout << "Need to shift the robot up" << endl;
+                if (verbose){
+                    cout << "Need to shift the robot up" << endl;
+                }
                 float x_disp = all_cubes[cube1].masses[map1[0]].position[0]-cube.masses[map2[0]].position[0]; //x displacement
                 float y_disp = all_cubes[cube1].masses[map1[0]].position[1]-cube.masses[map2[0]].position[1]; //y displacement
                 float z_disp = all_cubes[cube1].masses[map1[0]].position[2]-cube.masses[map2[0]].position[2]; //z displacement
                 
+                for (int n=0; n<masses.size(); n++){
+                    //shift the whole robot over
+                    masses[n].position[0] -= x_disp;
+                    masses[n].position[1] -= y_disp;
+                    masses[n].position[2] -= z_disp;
+                }
                 for (int m=0; m<all_cubes.size(); m++){
-                    for (int n=0; n<8; n++){
-                        //shift cube 2 over
-                        all_cubes[m].masses[n].position[0] -= x_disp;
-                        all_cubes[m].masses[n].position[1] -= y_disp;
-                        all_cubes[m].masses[n].position[2] -= z_disp;
-                        
-                        masses[all_cubes[m].masses[n].ID].position[0] = all_cubes[m].masses[n].position[0];
-                        masses[all_cubes[m].masses[n].ID].position[1] = all_cubes[m].masses[n].position[1];
-                        masses[all_cubes[m].masses[n].ID].position[2] = all_cubes[m].masses[n].position[2];
-                    }
                     all_cubes[m].center[0] -= x_disp;
                     all_cubes[m].center[1] -= y_disp;
                     all_cubes[m].center[2] -= z_disp;
                 }
+                sync_cube_masses(all_cubes, masses);
             }
             else{
                 //find where the second cube needs to join the first cube
@@ -1604,170 +2652,144 @@ void initialize_robot(Robot &robot){
                 cube.center[2] -= z_disp;
             }
             
-            fuse_faces(all_cubes[cube1], cube, cube1, i, masses, springs, cube1_face1, face_2, masses_left, springs_left);
+            fuse_faces(all_cubes[cube1], cube, cube1, i, masses, springs, cube1_face1, face_2, assembly);
             
-            for (int q=0; q<all_cubes.size(); q++){
-                if (all_cubes[q].center[0]-cube.center[0] == 0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[2]-cube.center[2] == 0 && q != cube1){
-                    cout << "Also a cube to the right" << endl;
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 2)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 4)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 2, 4, masses_left, springs_left);
-                }
-                else if (all_cubes[q].center[0]-cube.center[0] == -0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[2]-cube.center[2] == 0 && q != cube1){
-                    cout << "Also a cube to the left" << endl;
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 4)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 2)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 4, 2, masses_left, springs_left);
-                }
-                else if (all_cubes[q].center[1]-cube.center[1] == 0.5 && all_cubes[q].center[0]-cube.center[0] == 0 && all_cubes[q].center[2]-cube.center[2] == 0 && q != cube1){
-                    cout << "Also a cube in front" << endl;
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 1)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 3)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 1, 3, masses_left, springs_left);
-                }
-                else if (all_cubes[q].center[1]-cube.center[1] == -0.5 && all_cubes[q].center[2]-cube.center[2] == 0 && all_cubes[q].center[0]-cube.center[0] == 0 && q != cube1){
-                    cout << "Also a cube in back" << endl;
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 3)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 1)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 3, 1, masses_left, springs_left);
-                }
-                else if (all_cubes[q].center[2]-cube.center[2] == 0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[0]-cube.center[0] == 0 && q != cube1){
-                    cout << "Also a cube on top" << endl;
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 0)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 5)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 0, 5, masses_left, springs_left);
-                }
-                else if (all_cubes[q].center[2]-cube.center[2] == -0.5 && all_cubes[q].center[1]-cube.center[1] == 0 && all_cubes[q].center[0]-cube.center[0] == 0 && q != cube1){
-                    cout << "Also a cube on bottom" << endl;
-                    
-                    int itr3 = find(all_cubes[q].free_faces.begin(), all_cubes[q].free_faces.end(), 5)-all_cubes[q].free_faces.begin();
-                    int itr4 = find(cube.free_faces.begin(), cube.free_faces.end(), 0)-cube.free_faces.begin();
-                    
-                    all_cubes[q].free_faces.erase(all_cubes[q].free_faces.begin()+itr3);
-                    cube.free_faces.erase(cube.free_faces.begin()+itr4);
-                    
-                    fuse_faces(all_cubes[q], cube, q, i, masses, springs, 5, 0, masses_left, springs_left);
-                }
-            }
+            fuse_neighbors(all_cubes, cube, cube1, i, scratch, available_cubes, masses, springs, verbose);
             
-            for (int j=0; j<masses_left.size(); j++){
+            for (int v=0; v<8; v++){
                 // if the vertex is not part of face 2 then you can add it to the big vector of masses and make the ID the index of where it is in the big vector of masses
-                cube.masses[masses_left[j]].ID = masses.size();
-                cube.massIDs.push_back(masses.size());
-                masses.push_back(cube.masses[masses_left[j]]);
-                
+                if (assembly.masses_left >> v & 1){
+                    cube.masses[v].ID = masses.size();
+                    cube.massIDs.push_back(masses.size());
+                    masses.push_back(cube.masses[v]);
+                }
             }
             
-            for (int k=0; k<springs_left.size(); k++){
-                int p0 = cube.springs[springs_left[k]].m0;
-                int p1 = cube.springs[springs_left[k]].m1;
-                
-                cube.springs[springs_left[k]].m0 = cube.masses[p0].ID;
-                cube.springs[springs_left[k]].m1 = cube.masses[p1].ID;
-                cube.springs[springs_left[k]].ID = springs.size();
-                cube.springIDs.push_back(springs.size());
-                springs.push_back(cube.springs[springs_left[k]]);
-                
+            for (int k=0; k<28; k++){
+                if (assembly.springs_left >> k & 1){
+                    int p0 = cube.springs[k].m0;
+                    int p1 = cube.springs[k].m1;
+                    
+                    cube.springs[k].m0 = cube.masses[p0].ID;
+                    cube.springs[k].m1 = cube.masses[p1].ID;
+                    cube.springs[k].ID = springs.size();
+                    cube.springIDs.push_back(springs.size());
+                    springs.push_back(cube.springs[k]);
+                }
             }
             
-            if (cube.free_faces.size() < 1){
+            if (cube.free_faces == 0){
                 cout << "Maximized fused faces on this cube" << endl;
             }
             else{
-                available_cubes.push_back(i);
+                pool_add(available_cubes, i);
             }
-            if (all_cubes[cube1].free_faces.size() < 1){
+            if (all_cubes[cube1].free_faces == 0){
                 cout << "Maximized fused faces on this cube" << endl;
-                int itr5 = find(available_cubes.begin(), available_cubes.end(), cube1)-available_cubes.begin();
-                available_cubes.erase(available_cubes.begin()+itr5);
+                pool_remove(available_cubes, cube1);
             }
             
         }
         
-        cubes.push_back(i);
-        all_cubes.push_back(cube);
+        
+        all_cubes.push_back(move(cube));
     }
-    robot.masses = masses;
-    robot.springs = springs;
-    robot.all_cubes = all_cubes;
-    robot.available_cubes = available_cubes;
+    
+    hash_shape(body);
+    build_sim_template(body);
 }
 
-void fuse_faces(Cube &cube1, Cube &cube2, int cube1_index, int cube2_index, vector<PointMass> &masses, vector<Spring> &springs, int combine1, int combine2, vector<int> &masses_left, vector<int> &springs_left){
-    
-    vector<int> map1;
-    vector<int> map2;
-    vector<int> map1_springs;
-    vector<int> map2_springs;
-    
-    if (combine1 == 0){
-        map1 = face0;
-        map2 = face5;
-        
-        map1_springs = face0_springs;
-        map2_springs = face5_springs;
+int64_t voxel_key(int x, int y, int z){
+    //21 bits per axis, offset so negative coordinates pack too
+    return ((int64_t)(x+(1 << 20)) << 42) | ((int64_t)(y+(1 << 20)) << 21) | (int64_t)(z+(1 << 20));
+}
+
+int nth_set_bit(uint32_t bits, int n){
+    //index of the set bit with n set bits below it, so a random pick from a mask matches a pick from its sorted list
+    for (int i=0; i<n; i++){
+        bits &= bits-1;
     }
-    else if (combine1 == 5){
-        map1 = face5;
-        map2 = face0;
-        
-        map1_springs = face5_springs;
-        map2_springs = face0_springs;
+    return __builtin_ctz(bits);
+}
+
+void pool_add(CubePool &pool, int cube){
+    pool.slot[cube] = (int)pool.cubes.size();
+    pool.cubes.push_back(cube);
+}
+
+void pool_remove(CubePool &pool, int cube){
+    int hole = pool.slot[cube];
+    if (hole < 0){
+        return;
     }
-    else if (combine1 == 1){
-        map1 = face1;
-        map2 = face3;
-        
-        map1_springs = face1_springs;
-        map2_springs = face3_springs;
+    int last = pool.cubes.back();
+    pool.cubes[hole] = last;
+    pool.slot[last] = hole;
+    pool.cubes.pop_back();
+    pool.slot[cube] = -1;
+}
+
+void fuse_neighbors(vector<Cube> &all_cubes, Cube &cube, int cube1, int cube_index, BuildScratch &scratch, CubePool &available_cubes, vector<PointMass> &masses, vector<Spring> &springs, bool verbose){
+    //fuses the new cube to every placed cube beside it other than cube1, which it was just attached to, then records it in the grid
+    const int offsets[6][3] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+    const int their_faces[6] = {2, 4, 1, 3, 0, 5};
+    const int our_faces[6] = {4, 2, 3, 1, 5, 0};
+    const char *messages[6] = {"Also a cube to the right", "Also a cube to the left", "Also a cube in front", "Also a cube in back", "Also a cube on top", "Also a cube on bottom"};
+    
+    int voxel[3];
+    for (int a=0; a<3; a++){
+        //centers sit on a half unit lattice, so rounding also absorbs any float drift from the shifts
+        voxel[a] = (int)lround((cube.center[a]-all_cubes[0].center[a])/0.5f);
     }
-    else if (combine1 == 3){
-        map1 = face3;
-        map2 = face1;
-        
-        map1_springs = face3_springs;
-        map2_springs = face1_springs;
+    
+    vector<pair<int, int>> &neighbors = scratch.neighbors;
+    neighbors.clear();
+    const vector<pair<int64_t, int>> &cells = scratch.grid.cells;
+    for (int d=0; d<6; d++){
+        int64_t key = voxel_key(voxel[0]+offsets[d][0], voxel[1]+offsets[d][1], voxel[2]+offsets[d][2]);
+        for (auto found = lower_bound(cells.begin(), cells.end(), make_pair(key, INT_MIN)); found != cells.end() && found->first == key; found++){
+            if (found->second != cube1){
+                neighbors.push_back(make_pair(found->second, d));
+            }
+        }
     }
-    else if (combine1 == 2){
-        map1 = face2;
-        map2 = face4;
+    sort(neighbors.begin(), neighbors.end()); //fuse in cube order like the old scan, which fixes how masses and springs get numbered
+    
+    for (int n=0; n<neighbors.size(); n++){
+        int q = neighbors[n].first;
+        int d = neighbors[n].second;
+        if (verbose){
+            cout << messages[d] << endl;
+        }
         
-        map1_springs = face2_springs;
-        map2_springs = face4_springs;
-    }
-    else{
-        map1 = face4;
-        map2 = face2;
+        all_cubes[q].free_faces &= ~(1u << their_faces[d]);
+        cube.free_faces &= ~(1u << our_faces[d]);
+        
+        fuse_faces(all_cubes[q], cube, q, cube_index, masses, springs, their_faces[d], our_faces[d], scratch.assembly);
         
-        map1_springs = face4_springs;
-        map2_springs = face2_springs;
+        if (all_cubes[q].free_faces == 0){
+            //a neighbour can be closed off too; left in available_cubes it would be picked with no face to offer
+            cout << "Maximized fused faces on this cube" << endl;
+            pool_remove(available_cubes, q);
+        }
     }
     
+    grid_add(scratch.grid, voxel_key(voxel[0], voxel[1], voxel[2]), cube_index);
+}
+
+void grid_add(CubeGrid &grid, int64_t key, int cube){
+    //keeps cells sorted, so a voxel's cubes are one binary search away and come out in cube order
+    pair<int64_t, int> cell = make_pair(key, cube);
+    grid.cells.insert(upper_bound(grid.cells.begin(), grid.cells.end(), cell), cell);
+}
+
+void fuse_faces(Cube &cube1, Cube &cube2, int cube1_index, int cube2_index, vector<PointMass> &masses, vector<Spring> &springs, int combine1, int combine2, CubeAssembly &assembly){
+    
+    const array<int, 4> &map1 = face_vertices[combine1];
+    const array<int, 4> &map2 = face_vertices[opposite_face[combine1]];
+    const array<int, 6> &map1_springs = face_springs[combine1];
+    const array<int, 6> &map2_springs = face_springs[opposite_face[combine1]];
+    
     cube1.joinedCubes.push_back(cube2_index);
     cube1.joinedFaces.push_back(combine1);
     cube1.otherFaces.push_back(combine2);
@@ -1777,37 +2799,36 @@ void fuse_faces(Cube &cube1, Cube &cube2, int cube1_index, int cube2_index, vect
     cube2.otherFaces.push_back(combine1);
     
     //joining cube 2 on the right face of the first cube; this means the left face of cube 2 and the right face of cube 1 will be joined
+    //cube2 is always the cube being placed, so "already in cube2's massIDs" is "stamped with cube2_index"
     for (int j=0; j<map2.size(); j++){
-        if (find(cube2.massIDs.begin(), cube2.massIDs.end(), cube1.masses[map1[j]].ID) == cube2.massIDs.end()){
-            cube2.masses[map2[j]].ID = cube1.masses[map1[j]].ID; //set the mass ID to its position in the masses vector of the robot
-            cube2.massIDs.push_back(cube1.masses[map1[j]].ID); //add the mass IDs to the list of masses that correspond to cube2
+        int shared = cube1.masses[map1[j]].ID;
+        if (assembly.mass_cube[shared] != cube2_index){
+            cube2.masses[map2[j]].ID = shared; //set the mass ID to its position in the masses vector of the robot
+            cube2.massIDs.push_back(shared); //add the mass IDs to the list of masses that correspond to cube2
+            assembly.mass_cube[shared] = cube2_index;
         }
         
-        if (find(masses_left.begin(), masses_left.end(), map2[j]) != masses_left.end()){
-//            remove(masses_left.begin(), masses_left.end(), map2[j]);
-            int itr = find(masses_left.begin(), masses_left.end(), map2[j])-masses_left.begin();
-            masses_left.erase(masses_left.begin()+itr);
-        }
+        assembly.masses_left &= ~(1u << map2[j]);
     }
     
     for (int k=0; k<map2_springs.size(); k++){
-        int p0 = cube2.springs[map2_springs[k]].m0;
-        int p1 = cube2.springs[map2_springs[k]].m1;
-        
-        cube2.springs[map2_springs[k]].m0 = cube2.masses[p0].ID;
-        cube2.springs[map2_springs[k]].m1 = cube2.masses[p1].ID;
-        
-        if (find(cube2.springIDs.begin(), cube2.springIDs.end(), cube1.springs[map1_springs[k]].ID) == cube2.springIDs.end()){
-            cube2.springs[map2_springs[k]].ID = cube1.springs[map1_springs[k]].ID;
-            cube2.springIDs.push_back(cube1.springs[map1_springs[k]].ID);
+        if (assembly.springs_left >> map2_springs[k] & 1){
+            //an edge shared with a face fused earlier already holds robot mass indices, which are not cube vertex numbers
+            int p0 = cube2.springs[map2_springs[k]].m0;
+            int p1 = cube2.springs[map2_springs[k]].m1;
+
+            cube2.springs[map2_springs[k]].m0 = cube2.masses[p0].ID;
+            cube2.springs[map2_springs[k]].m1 = cube2.masses[p1].ID;
         }
-        
-        
-        if (find(springs_left.begin(), springs_left.end(), map2_springs[k]) != springs_left.end()){
-//            remove(springs_left.begin(), springs_left.end(), map2_springs[k]);
-            int itr = find(springs_left.begin(), springs_left.end(), map2_springs[k])-springs_left.begin();
-            springs_left.erase(springs_left.begin()+itr);
+
+        int shared = cube1.springs[map1_springs[k]].ID;
+        if (assembly.spring_cube[shared] != cube2_index){
+            cube2.springs[map2_springs[k]].ID = shared;
+            cube2.springIDs.push_back(shared);
+            assembly.spring_cube[shared] = cube2_index;
         }
+        
+        assembly.springs_left &= ~(1u << map2_springs[k]);
     }
 }
 
@@ -1818,12 +2839,10 @@ void initialize_cube(Cube &cube){
     initialize_masses(masses);
     initialize_springs(springs);
     
-    cube.masses = masses;
-    cube.springs = springs;
+    cube.masses = move(masses);
+    cube.springs = move(springs);
     
-    for (int i=0; i<6; i++){
-        cube.free_faces.push_back(i);
-    }
+    cube.free_faces = (1u << 6)-1;
     
     float x_center = 0;
     float y_center = 0;
@@ -1843,347 +2862,28 @@ void initialize_cube(Cube &cube){
 }
 
 void initialize_masses(vector<PointMass> &masses){
-    //Point Mass of bottom, front left vertex
-    //----------------------
-    PointMass mass0;
-    mass0.mass = 1.0f;
-    mass0.position = {-0.25f, -0.25f, 0.0f};
-    mass0.velocity = {0.0f, 0.0f, 0.0f};
-    mass0.acceleration = {0.0f, 0.0f, 0.0f};
-    mass0.forces = {0.0f, 0.0f, 0.0f};
-    //----------------------
-    
-    //Point Mass of bottom, back left vertex
-    //----------------------
-    PointMass mass1;
-    mass1.mass = 1.0f;
-    mass1.position = {-0.25f, 0.25f, 0.0f};
-    mass1.velocity = {0.0f, 0.0f, 0.0f};
-    mass1.acceleration = {0.0f, 0.0f, 0.0f};
-    mass1.forces = {0.0f, 0.0f, 0.0f};
-    //----------------------
-    
-    //Point Mass of bottom, back right vertex
-    //----------------------
-    PointMass mass2;
-    mass2.mass = 1.0f;
-    mass2.position = {0.25f, 0.25f, 0.0f};
-    mass2.velocity = {0.0f, 0.0f, 0.0f};
-    mass2.acceleration = {0.0f, 0.0f, 0.0f};
-    mass2.forces = {0.0f, 0.0f, 0.0f};
-    //----------------------
-    
-    //Point Mass of bottom, front right vertex
-    //----------------------
-    PointMass mass3;
-    mass3.mass = 1.0f;
-    mass3.position = {0.25f, -0.25f, 0.0f};
-    mass3.velocity = {0.0f, 0.0f, 0.0f};
-    mass3.acceleration = {0.0f, 0.0f, 0.0f};
-    mass3.forces = {0.0f, 0.0f, 0.0f};
-    //----------------------
-    
-    //Point Mass of top, front left vertex
-    //----------------------
-    PointMass mass4;
-    mass4.mass = 1.0f;
-    mass4.position = {-0.25f, -0.25f, 0.5f};
-    mass4.velocity = {0.0f, 0.0f, 0.0f};
-    mass4.acceleration = {0.0f, 0.0f, 0.0f};
-    mass4.forces = {0.0f, 0.0f, 0.0f};
-    //----------------------
-    
-    //Point Mass of top, back left vertex
-    //----------------------
-    PointMass mass5;
-    mass5.mass = 1.0f;
-    mass5.position = {-0.25f, 0.25f, 0.5f};
-    mass5.velocity = {0.0f, 0.0f, 0.0f};
-    mass5.acceleration = {0.0f, 0.0f, 0.0f};
-    mass5.forces = {0.0f, 0.0f, 0.0f};
-    //----------------------
-    
-    //Point Mass of top, back right vertex
-    //----------------------
-    PointMass mass6;
-    mass6.mass = 1.0f;
-    mass6.position = {0.25f, 0.25f, 0.5f};
-    mass6.velocity = {0.0f, 0.0f, 0.0f};
-    mass6.acceleration = {0.0f, 0.0f, 0.0f};
-    mass6.forces = {0.0f, 0.0f, 0.0f};
-    //----------------------
-    
-    //Point Mass of top, front right vertex
-    //----------------------
-    PointMass mass7;
-    mass7.mass = 1.0f;
-    mass7.position = {0.25f, -0.25f, 0.5f};
-    mass7.velocity = {0.0f, 0.0f, 0.0f};
-    mass7.acceleration = {0.0f, 0.0f, 0.0f};
-    mass7.forces = {0.0f, 0.0f, 0.0f};
-    //----------------------
-    
-    masses = {mass0, mass1, mass2, mass3, mass4, mass5, mass6, mass7};
-    
+    //stamps out the unit cube's vertices
+    masses.resize(unit_cube_vertices.size());
+    for (int i=0; i<unit_cube_vertices.size(); i++){
+        masses[i].mass = 1.0f;
+        masses[i].position = {unit_cube_vertices[i][0], unit_cube_vertices[i][1], unit_cube_vertices[i][2]};
+        masses[i].velocity = {0.0f, 0.0f, 0.0f};
+        masses[i].acceleration = {0.0f, 0.0f, 0.0f};
+        masses[i].forces = {0.0f, 0.0f, 0.0f};
+    }
 }
 
 void initialize_springs(vector<Spring> &springs){
-    
-    //Bottom Face of the Cube
-    //-----------------------
-    Spring spring0;
-    spring0.L0 = 0.5f;
-    spring0.L = 0.5f;
-    spring0.k = spring_constant;
-    spring0.m0 = 0;
-    spring0.m1 = 1;
-    spring0.original_L0 = 0.5f;
-    
-    Spring spring1;
-    spring1.L0 = 0.5f;
-    spring1.L = 0.5f;
-    spring1.k = spring_constant;
-    spring1.m0 = 1;
-    spring1.m1 = 2;
-    spring1.original_L0 = 0.5f;
-    
-    Spring spring2;
-    spring2.L0 = 0.5f;
-    spring2.L = 0.5f;
-    spring2.k = spring_constant;
-    spring2.m0 = 2;
-    spring2.m1 = 3;
-    spring2.original_L0 = 0.5f;
-    
-    Spring spring3;
-    spring3.L0 = 0.5f;
-    spring3.L = 0.5f;
-    spring3.k = spring_constant;
-    spring3.m0 = 3;
-    spring3.m1 = 0;
-    spring3.original_L0 = 0.5f;
-    //----------------------
-    
-    //Cross Springs of Bottom Face
-    //----------------------
-    Spring spring4;
-    spring4.L0 = 0.5f*sqrt(2.0f);
-    spring4.L = 0.5f*sqrt(2.0f);
-    spring4.k = spring_constant;
-    spring4.m0 = 0;
-    spring4.m1 = 2;
-    spring4.original_L0 = 0.5f*sqrt(2.0f);
-    
-    Spring spring5;
-    spring5.L0 = 0.5f*sqrt(2.0f);
-    spring5.L = 0.5f*sqrt(2.0f);
-    spring5.k = spring_constant;
-    spring5.m0 = 1;
-    spring5.m1 = 3;
-    spring5.original_L0 = 0.5f*sqrt(2.0f);
-    //----------------------
-    
-    //Vertical Supports of Cube
-    //----------------------
-    Spring spring6;
-    spring6.L0 = 0.5f;
-    spring6.L = 0.5f;
-    spring6.k = spring_constant;
-    spring6.m0 = 0;
-    spring6.m1 = 4;
-    spring6.original_L0 = 0.5f;
-    
-    Spring spring7;
-    spring7.L0 = 0.5f;
-    spring7.L = 0.5f;
-    spring7.k = spring_constant;
-    spring7.m0 = 1;
-    spring7.m1 = 5;
-    spring7.original_L0 = 0.5f;
-    
-    Spring spring8;
-    spring8.L0 = 0.5f;
-    spring8.L = 0.5f;
-    spring8.k = spring_constant;
-    spring8.m0 = 2;
-    spring8.m1 = 6;
-    spring8.original_L0 = 0.5f;
-    
-    Spring spring9;
-    spring9.L0 = 0.5f;
-    spring9.L = 0.5f;
-    spring9.k = spring_constant;
-    spring9.m0 = 3;
-    spring9.m1 = 7;
-    spring9.original_L0 = 0.5f;
-    //---------------------
-    
-    //Cross Springs of Front Face
-    //---------------------
-    Spring spring10;
-    spring10.L0 = 0.5f*sqrt(2.0f);
-    spring10.L = 0.5f*sqrt(2.0f);
-    spring10.k = spring_constant;
-    spring10.m0 = 0;
-    spring10.m1 = 7;
-    spring10.original_L0 = 0.5f*sqrt(2.0f);
-    
-    Spring spring11;
-    spring11.L0 = 0.5f*sqrt(2.0f);
-    spring11.L = 0.5f*sqrt(2.0f);
-    spring11.k = spring_constant;
-    spring11.m0 = 3;
-    spring11.m1 = 4;
-    spring11.original_L0 = 0.5f*sqrt(2.0f);
-    //---------------------
-    
-    //Cross Springs of Left Face
-    //---------------------
-    Spring spring12;
-    spring12.L0 = 0.5f*sqrt(2.0f);
-    spring12.L = 0.5f*sqrt(2.0f);
-    spring12.k = spring_constant;
-    spring12.m0 = 0;
-    spring12.m1 = 5;
-    spring12.original_L0 = 0.5f*sqrt(2.0f);
-    
-    Spring spring13;
-    spring13.L0 = 0.5f*sqrt(2.0f);
-    spring13.L = 0.5f*sqrt(2.0f);
-    spring13.k = spring_constant;
-    spring13.m0 = 1;
-    spring13.m1 = 4;
-    spring13.original_L0 = 0.5f*sqrt(2.0f);
-    //---------------------
-    
-    //Cross Springs of Back Face
-    //---------------------
-    Spring spring14;
-    spring14.L0 = 0.5f*sqrt(2.0f);
-    spring14.L = 0.5f*sqrt(2.0f);
-    spring14.k = spring_constant;
-    spring14.m0 = 1;
-    spring14.m1 = 6;
-    spring14.original_L0 = 0.5f*sqrt(2.0f);
-    
-    Spring spring15;
-    spring15.L0 = 0.5f*sqrt(2.0f);
-    spring15.L = 0.5f*sqrt(2.0f);
-    spring15.k = spring_constant;
-    spring15.m0 = 2;
-    spring15.m1 = 5;
-    spring15.original_L0 = 0.5f*sqrt(2.0f);
-    //---------------------
-    
-    //Cross Springs of Right Face
-    //---------------------
-    Spring spring16;
-    spring16.L0 = 0.5f*sqrt(2.0f);
-    spring16.L = 0.5f*sqrt(2.0f);
-    spring16.k = spring_constant;
-    spring16.m0 = 2;
-    spring16.m1 = 7;
-    spring16.original_L0 = 0.5f*sqrt(2.0f);
-    
-    Spring spring17;
-    spring17.L0 = 0.5f*sqrt(2.0f);
-    spring17.L = 0.5f*sqrt(2.0f);
-    spring17.k = spring_constant;
-    spring17.m0 = 3;
-    spring17.m1 = 6;
-    spring17.original_L0 = 0.5f*sqrt(2.0f);
-    //---------------------
-    
-    //Top Face of the Cube
-    //---------------------
-    Spring spring18;
-    spring18.L0 = 0.5f;
-    spring18.L = 0.5f;
-    spring18.k = spring_constant;
-    spring18.m0 = 4;
-    spring18.m1 = 5;
-    spring18.original_L0 = 0.5f;
-    
-    Spring spring19;
-    spring19.L0 = 0.5f;
-    spring19.L = 0.5f;
-    spring19.k = spring_constant;
-    spring19.m0 = 5;
-    spring19.m1 = 6;
-    spring19.original_L0 = 0.5f;
-    
-    Spring spring20;
-    spring20.L0 = 0.5f;
-    spring20.L = 0.5f;
-    spring20.k = spring_constant;
-    spring20.m0 = 6;
-    spring20.m1 = 7;
-    spring20.original_L0 = 0.5f;
-    
-    Spring spring21;
-    spring21.L0 = 0.5f;
-    spring21.L = 0.5f;
-    spring21.k = spring_constant;
-    spring21.m0 = 7;
-    spring21.m1 = 4;
-    spring21.original_L0 = 0.5f;
-    //---------------------
-    
-    //Cross Springs of Top Face
-    //---------------------
-    Spring spring22;
-    spring22.L0 = 0.5f*sqrt(2.0f);
-    spring22.L = 0.5f*sqrt(2.0f);
-    spring22.k = spring_constant;
-    spring22.m0 = 4;
-    spring22.m1 = 6;
-    spring22.original_L0 = 0.5f*sqrt(2.0f);
-    
-    Spring spring23;
-    spring23.L0 = 0.5f*sqrt(2.0f);
-    spring23.L = 0.5f*sqrt(2.0f);
-    spring23.k = spring_constant;
-    spring23.m0 = 5;
-    spring23.m1 = 7;
-    spring23.original_L0 = 0.5f*sqrt(2.0f);
-    //---------------------
-    
-    //Inner Cross Springs
-    //---------------------
-    Spring spring24;
-    spring24.L0 = 0.5f*sqrt(3.0f);
-    spring24.L = 0.5f*sqrt(3.0f);
-    spring24.k = spring_constant;
-    spring24.m0 = 0;
-    spring24.m1 = 6;
-    spring24.original_L0 = 0.5f*sqrt(3.0f);
-    
-    Spring spring25;
-    spring25.L0 = 0.5f*sqrt(3.0f);
-    spring25.L = 0.5f*sqrt(3.0f);
-    spring25.k = spring_constant;
-    spring25.m0 = 2;
-    spring25.m1 = 4;
-    spring25.original_L0 = 0.5f*sqrt(3.0f);
-    
-    Spring spring26;
-    spring26.L0 = 0.5f*sqrt(3.0f);
-    spring26.L = 0.5f*sqrt(3.0f);
-    spring26.k = spring_constant;
-    spring26.m0 = 1;
-    spring26.m1 = 7;
-    spring26.original_L0 = 0.5f*sqrt(3.0f);
-    
-    Spring spring27;
-    spring27.L0 = 0.5f*sqrt(3.0f);
-    spring27.L = 0.5f*sqrt(3.0f);
-    spring27.k = spring_constant;
-    spring27.m0 = 3;
-    spring27.m1 = 5;
-    spring27.original_L0 = 0.5f*sqrt(3.0f);
-    //---------------------
-    
-    springs = {spring0, spring1, spring2, spring3, spring4, spring5, spring6, spring7, spring8, spring9, spring10, spring11, spring12, spring13, spring14, spring15, spring16, spring17, spring18, spring19, spring20, spring21, spring22, spring23, spring24, spring25, spring26, spring27};
+    //stamps out the unit cube's springs, all at rest
+    springs.resize(unit_cube_springs.size());
+    for (int i=0; i<unit_cube_springs.size(); i++){
+        springs[i].L0 = unit_cube_springs[i].L0;
+        springs[i].L = unit_cube_springs[i].L0;
+        springs[i].k = spring_constant;
+        springs[i].m0 = unit_cube_springs[i].m0;
+        springs[i].m1 = unit_cube_springs[i].m1;
+        springs[i].original_L0 = unit_cube_springs[i].L0;
+    }
 }
 //-----------------------------------------------------------------------
 